@@ -0,0 +1,87 @@
+// Opengl version >= 1.3
+#version 130
+
+// Filters applied to the screenshot before it is shown, see `filters` in
+// config.conf. zooc builds this file once per filter in the chain, with
+// FILTER_<NAME> defined, and VERTEX or FRAGMENT for the stage. Every pass
+// covers the whole target one texel to one pixel, so add your own filters
+// here under a name of their own.
+
+#ifdef VERTEX
+
+// A single triangle covering the target
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#else
+
+out vec4 color;
+
+uniform sampler2D tex;          // output of the previous filter
+uniform vec2      size;         // texels in use, tex may be larger
+uniform float     strength;     // the number after the filter's name
+
+// The image is filtered a tile at a time with a border borrowed from its
+// neighbours, one texel per filter in the chain. Keep offsets within it.
+vec4 fetch(ivec2 offset)
+{
+    ivec2 p = clamp(ivec2(gl_FragCoord.xy) + offset, ivec2(0), ivec2(size) - 1);
+    return texelFetch(tex, p, 0);
+}
+
+float luma(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Simulated color vision deficiencies, Machado et al. (2009) at full
+// severity. strength mixes between the original and the simulation.
+vec3 simulate(mat3 m, vec3 c)
+{
+    return mix(c, clamp(m * c, 0.0, 1.0), strength);
+}
+
+void main()
+{
+    vec4 c = fetch(ivec2(0));
+
+#if defined(FILTER_CONTRAST)
+    color = vec4(clamp((c.rgb - 0.5) * (1.0 + strength) + 0.5, 0.0, 1.0), 1.0);
+#elif defined(FILTER_INVERT)
+    color = vec4(mix(c.rgb, 1.0 - c.rgb, strength), 1.0);
+#elif defined(FILTER_GRAYSCALE)
+    color = vec4(mix(c.rgb, vec3(luma(c.rgb)), strength), 1.0);
+#elif defined(FILTER_EDGES)
+    // Sobel on the luminance
+    float tl = luma(fetch(ivec2(-1, -1)).rgb), t = luma(fetch(ivec2(0, -1)).rgb);
+    float tr = luma(fetch(ivec2( 1, -1)).rgb), l = luma(fetch(ivec2(-1, 0)).rgb);
+    float r  = luma(fetch(ivec2( 1,  0)).rgb), bl = luma(fetch(ivec2(-1, 1)).rgb);
+    float b  = luma(fetch(ivec2( 0,  1)).rgb), br = luma(fetch(ivec2( 1, 1)).rgb);
+    float gx = (tr + 2.0 * r + br) - (tl + 2.0 * l + bl);
+    float gy = (bl + 2.0 * b + br) - (tl + 2.0 * t + tr);
+    color = vec4(vec3(clamp(length(vec2(gx, gy)) * strength, 0.0, 1.0)), 1.0);
+#elif defined(FILTER_PROTANOPIA)
+    // GLSL matrices are given column by column
+    color = vec4(simulate(mat3(
+         0.152286,  0.114503, -0.003882,
+         1.052583,  0.786281, -0.048116,
+        -0.204868,  0.099216,  1.051998), c.rgb), 1.0);
+#elif defined(FILTER_DEUTERANOPIA)
+    color = vec4(simulate(mat3(
+         0.367322,  0.280085, -0.011820,
+         0.860646,  0.672501,  0.042940,
+        -0.227968,  0.047413,  0.968881), c.rgb), 1.0);
+#elif defined(FILTER_TRITANOPIA)
+    color = vec4(simulate(mat3(
+         1.255528, -0.078411,  0.004733,
+        -0.076749,  0.930809,  0.691367,
+        -0.178779,  0.147602,  0.303900), c.rgb), 1.0);
+#else
+#error unknown filter
+#endif
+}
+
+#endif
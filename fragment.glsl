@@ -13,8 +13,73 @@ uniform float flShadow;         // Percentage to dim around flashlight
 uniform float flRadius;         // Radius of flashlight
 uniform float cameraScale;      // Camera scaling
 
+// zooc builds this shader once per variant, with one of these defined:
+//   PLAIN       the screenshot as is, while the flashlight is off
+//   DIM         the screenshot dimmed by flShadow, away from the flashlight
+//   FLASHLIGHT  dimmed around an anti-aliased circle at the cursor
+// and, depending on `magnify`, BICUBIC or LANCZOS.
+
+#if defined(BICUBIC) || defined(LANCZOS)
+// Weight of a texel `x` texels away from the sample
+float weight(float x)
+{
+    x = abs(x);
+#if defined(BICUBIC)
+    // Catmull-Rom
+    if (x < 1.0)
+        return (1.5 * x - 2.5) * x * x + 1.0;
+    if (x < 2.0)
+        return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+    return 0.0;
+#else
+    // Lanczos with two lobes
+    if (x < 1e-5)
+        return 1.0;
+    if (x >= 2.0)
+        return 0.0;
+    float px = 3.14159265 * x;
+    return 2.0 * sin(px) * sin(px * 0.5) / (px * px);
+#endif
+}
+
+// Zoomed in, filter the 4x4 texels around the sample. Zoomed out the
+// texture's own (trilinear) filtering does better.
+vec4 screenshot(vec2 uv)
+{
+    if (cameraScale <= 1.0)
+        return texture(tex, uv);
+
+    ivec2 size = textureSize(tex, 0);
+    vec2 p = uv * vec2(size) - 0.5;
+    vec2 base = floor(p);
+    vec2 f = p - base;
+
+    vec4 sum = vec4(0.0);
+    float total = 0.0;
+    for (int j = -1; j <= 2; j++) {
+        for (int i = -1; i <= 2; i++) {
+            ivec2 texel = clamp(ivec2(base) + ivec2(i, j), ivec2(0), size - 1);
+            float w = weight(float(i) - f.x) * weight(float(j) - f.y);
+            sum += w * texelFetch(tex, texel, 0);
+            total += w;
+        }
+    }
+    return sum / total;
+}
+#else
+vec4 screenshot(vec2 uv)
+{
+    return texture(tex, uv);
+}
+#endif
+
 void main()
 {
+#if defined(PLAIN)
+    color = screenshot(texcoord);
+#elif defined(DIM)
+    color = screenshot(texcoord) * (1.0 - flShadow);
+#else
     // Opengl counts y differently, so we have to take the position from the 
     // bottom of the screen (windowSize.y - cursorPos.y).
     vec4 cursor = vec4(cursorPos.x, windowSize.y - cursorPos.y, 0.0, 1.0);
@@ -29,7 +94,8 @@ void main()
     float alpha = smoothstep(flRadius * cameraScale - delta, flRadius * cameraScale, dist);
 
     color = mix(
-        texture(tex, texcoord), vec4(0.0, 0.0, 0.0, 0.0), 
+        screenshot(texcoord), vec4(0.0, 0.0, 0.0, 0.0), 
         min(alpha, flShadow)
     );
+#endif
 }
@@ -0,0 +1,318 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include "capture.h"
+#include "timing.h"
+#include "util.h"
+
+#define BENCH_DEFAULT_ITERATIONS 20
+
+static bool shm_attach(Display *, XShmSegmentInfo *);
+static int shm_error_handler(Display *, XErrorEvent *);
+static void *capture_thread(void *);
+
+/* The error handler is shared by every thread and connection. One attach
+ * check at a time swaps it, errors on other connections are passed on.
+ */
+static pthread_mutex_t shm_lock = PTHREAD_MUTEX_INITIALIZER;
+static Display *shm_display = NULL;
+static int (*shm_previous_handler)(Display *, XErrorEvent *) = NULL;
+static bool shm_error = false;
+
+static const char *backend_names[CAPTURE_BACKEND_COUNT] = {
+    [CAPTURE_XLIB] = "xlib",
+    [CAPTURE_SHM]  = "mit-shm",
+};
+
+const char *
+capture_backend_name(CaptureBackend backend)
+{
+    return backend_names[backend];
+}
+
+static int
+shm_error_handler(Display *dpy, XErrorEvent *ev)
+{
+    if (dpy != shm_display)
+        return shm_previous_handler != NULL ? shm_previous_handler(dpy, ev) : 0;
+
+    shm_error = true;
+    return 0;
+}
+
+/* XShmQueryExtension happily reports the extension on remote displays as
+ * well, where the server can never see our segment. Only trust it when the
+ * display is reached through a local socket.
+ */
+bool
+capture_shm_usable(Display *dpy)
+{
+    if (!XShmQueryExtension(dpy))
+        return false;
+
+    const char *name = DisplayString(dpy);
+    if (name == NULL)
+        return false;
+
+    return name[0] == ':' || name[0] == '/' || !strncmp(name, "unix:", 5);
+}
+
+/* The attach request fails asynchronously, so the only reliable way to know
+ * whether the server accepted the segment is to sync with a temporary error
+ * handler installed.
+ */
+static bool
+shm_attach(Display *dpy, XShmSegmentInfo *info)
+{
+    pthread_mutex_lock(&shm_lock);
+    shm_display = dpy;
+    shm_error = false;
+    shm_previous_handler = XSetErrorHandler(shm_error_handler);
+    XShmAttach(dpy, info);
+    XSync(dpy, False);
+    XSetErrorHandler(shm_previous_handler);
+
+    bool ok = !shm_error;
+    shm_display = NULL;
+    pthread_mutex_unlock(&shm_lock);
+    return ok;
+}
+
+bool
+capture_create(Display *dpy, Capture *cap, CaptureBackend backend,
+        Drawable drawable, int x, int y, unsigned int width, unsigned int height)
+{
+    XWindowAttributes attrs;
+
+    memset(cap, 0, sizeof(*cap));
+    cap->backend  = backend;
+    cap->drawable = drawable;
+    cap->x = x;
+    cap->y = y;
+
+    if (backend == CAPTURE_XLIB) {
+        cap->image = XGetImage(dpy, drawable, x, y, width, height, AllPlanes, ZPixmap);
+        return cap->image != NULL;
+    }
+
+    if (!XGetWindowAttributes(dpy, drawable, &attrs))
+        return false;
+
+    cap->image = XShmCreateImage(
+        dpy, attrs.visual, attrs.depth, ZPixmap,
+        NULL, &cap->shminfo, width, height);
+    if (cap->image == NULL)
+        return false;
+
+    cap->capacity = (size_t)cap->image->bytes_per_line * cap->image->height;
+    cap->shminfo.shmid = shmget(IPC_PRIVATE, cap->capacity, IPC_CREAT | 0600);
+    if (cap->shminfo.shmid == -1)
+        goto fail_image;
+
+    cap->shminfo.shmaddr = cap->image->data = shmat(cap->shminfo.shmid, NULL, 0);
+    if (cap->shminfo.shmaddr == (char *)-1)
+        goto fail_segment;
+    cap->shminfo.readOnly = False;
+
+    if (!shm_attach(dpy, &cap->shminfo))
+        goto fail_detach;
+
+    /* Once both sides are attached the id is no longer needed, marking it for
+     * removal now guarantees the segment goes away even if we crash.
+     */
+    shmctl(cap->shminfo.shmid, IPC_RMID, NULL);
+
+    if (!capture_grab(dpy, cap)) {
+        capture_destroy(dpy, cap);
+        return false;
+    }
+    return true;
+
+fail_detach:
+    shmdt(cap->shminfo.shmaddr);
+fail_segment:
+    shmctl(cap->shminfo.shmid, IPC_RMID, NULL);
+fail_image:
+    cap->image->data = NULL;
+    XDestroyImage(cap->image);
+    cap->image = NULL;
+    return false;
+}
+
+/* Prefer MIT-SHM and silently fall back to a plain XGetImage when the
+ * extension is missing, the display is remote or the server refuses the
+ * segment.
+ */
+void
+capture_open(Display *dpy, Capture *cap, Drawable drawable,
+        int x, int y, unsigned int width, unsigned int height)
+{
+    if (capture_shm_usable(dpy)
+        && capture_create(dpy, cap, CAPTURE_SHM, drawable, x, y, width, height))
+        return;
+
+    if (!capture_create(dpy, cap, CAPTURE_XLIB, drawable, x, y, width, height))
+        die("Unable to capture the screen");
+}
+
+/* Refresh the contents of an existing capture in place. */
+bool
+capture_grab(Display *dpy, Capture *cap)
+{
+    if (cap->backend == CAPTURE_SHM)
+        return XShmGetImage(dpy, cap->drawable, cap->image, cap->x, cap->y, AllPlanes);
+
+    return XGetSubImage(
+        dpy, cap->drawable,
+        cap->x, cap->y,
+        cap->image->width, cap->image->height,
+        AllPlanes, ZPixmap,
+        cap->image, 0, 0) != NULL;
+}
+
+/* Grab a sub rectangle of the drawable, reshaping the capture image to the
+ * size of the rectangle. Shm captures can only hold as many bytes as their
+ * segment was created with.
+ */
+bool
+capture_region(Display *dpy, Capture *cap, int x, int y,
+        unsigned int width, unsigned int height)
+{
+    XImage *img = cap->image;
+
+    if (cap->backend == CAPTURE_XLIB) {
+        img = XGetImage(dpy, cap->drawable, x, y, width, height, AllPlanes, ZPixmap);
+        if (img == NULL)
+            return false;
+
+        XDestroyImage(cap->image);
+        cap->image = img;
+        return true;
+    }
+
+    int pad = img->bitmap_pad;
+    int bytes_per_line = (width * img->bits_per_pixel + pad - 1) / pad * (pad / 8);
+    if ((size_t)bytes_per_line * height > cap->capacity)
+        return false;
+
+    img->width  = width;
+    img->height = height;
+    img->bytes_per_line = bytes_per_line;
+
+    return XShmGetImage(dpy, cap->drawable, img, x, y, AllPlanes);
+}
+
+void
+capture_destroy(Display *dpy, Capture *cap)
+{
+    if (cap->image == NULL)
+        return;
+
+    if (cap->backend == CAPTURE_SHM) {
+        XShmDetach(dpy, &cap->shminfo);
+        XSync(dpy, False);
+        shmdt(cap->shminfo.shmaddr);
+        cap->image->data = NULL;
+    }
+
+    XDestroyImage(cap->image);
+    cap->image = NULL;
+}
+
+static void *
+capture_thread(void *arg)
+{
+    CaptureJob *job = arg;
+
+    timing_begin(STAGE_CAPTURE);
+    job->dpy = XOpenDisplay(job->display_name);
+    if (job->dpy == NULL)
+        die("Cannot open a second connection to the X display server for capture\n");
+
+    capture_open(job->dpy, &job->cap, DefaultRootWindow(job->dpy),
+        job->area.x, job->area.y, job->area.width, job->area.height);
+    timing_end(STAGE_CAPTURE);
+    return NULL;
+}
+
+/* Start capturing `area` of the root window in the background. Nothing but
+ * the worker may use the job until capture_finish. Xlib has to be set up
+ * for threads with XInitThreads before any display is opened.
+ */
+void
+capture_start(CaptureJob *job, const char *display_name, XRectangle area)
+{
+    *job = (CaptureJob) { .display_name = display_name, .area = area };
+
+    if (pthread_create(&job->thread, NULL, capture_thread, job) != 0)
+        die("Unable to start the capture thread\n");
+}
+
+/* Wait for the capture and hand it over, along with the connection it has
+ * to be destroyed on.
+ */
+Display *
+capture_finish(CaptureJob *job, Capture *cap)
+{
+    pthread_join(job->thread, NULL);
+    *cap = job->cap;
+    return job->dpy;
+}
+
+/* Time repeated full-root captures with every backend the display supports
+ * and print the latency of each.
+ */
+void
+capture_benchmark(Display *dpy, int iterations)
+{
+    XWindowAttributes root_attrs;
+    Window root = DefaultRootWindow(dpy);
+
+    if (iterations <= 0)
+        iterations = BENCH_DEFAULT_ITERATIONS;
+
+    XGetWindowAttributes(dpy, root, &root_attrs);
+    printf("capturing %dx%d root, %d iterations\n",
+        root_attrs.width, root_attrs.height, iterations);
+    printf("%-8s %10s %10s %10s %10s\n", "backend", "min ms", "avg ms", "max ms", "MB/s");
+
+    for (int b = 0; b < CAPTURE_BACKEND_COUNT; b++) {
+        Capture cap;
+
+        if (b == CAPTURE_SHM && !capture_shm_usable(dpy)) {
+            printf("%-8s %10s\n", backend_names[b], "unavailable");
+            continue;
+        }
+        if (!capture_create(dpy, &cap, b, root, 0, 0, root_attrs.width, root_attrs.height)) {
+            printf("%-8s %10s\n", backend_names[b], "failed");
+            continue;
+        }
+
+        double min = 1e30, max = 0.0, total = 0.0;
+        for (int i = 0; i < iterations; i++) {
+            uint64_t start = now_ns();
+            capture_grab(dpy, &cap);
+            double ms = (now_ns() - start) / 1e6;
+
+            min = MIN(min, ms);
+            max = MAX(max, ms);
+            total += ms;
+        }
+
+        double avg = total / iterations;
+        double bytes = (double)cap.image->bytes_per_line * cap.image->height;
+        printf("%-8s %10.2f %10.2f %10.2f %10.1f\n",
+            backend_names[b], min, avg, max, bytes / (avg / 1e3) / 1e6);
+
+        capture_destroy(dpy, &cap);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef ZOOC_CAPTURE_H
+#define ZOOC_CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+typedef enum {
+    CAPTURE_XLIB,
+    CAPTURE_SHM,
+    CAPTURE_BACKEND_COUNT,
+} CaptureBackend;
+
+typedef struct {
+    CaptureBackend backend;
+    XImage *image;
+    XShmSegmentInfo shminfo;
+    Drawable drawable;
+    int x;
+    int y;
+    size_t capacity;
+} Capture;
+
+/* A capture of part of the root window taken on a worker thread, over a
+ * connection of its own. The capture stays tied to that connection.
+ */
+typedef struct {
+    pthread_t thread;
+    const char *display_name;
+    XRectangle area;
+    Display *dpy;
+    Capture cap;
+} CaptureJob;
+
+const char *capture_backend_name(CaptureBackend);
+bool capture_shm_usable(Display *);
+bool capture_create(Display *, Capture *, CaptureBackend, Drawable, int, int, unsigned int, unsigned int);
+void capture_open(Display *, Capture *, Drawable, int, int, unsigned int, unsigned int);
+bool capture_grab(Display *, Capture *);
+bool capture_region(Display *, Capture *, int, int, unsigned int, unsigned int);
+void capture_destroy(Display *, Capture *);
+void capture_start(CaptureJob *, const char *, XRectangle);
+Display *capture_finish(CaptureJob *, Capture *);
+void capture_benchmark(Display *, int);
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <math.h>
 #include <sys/stat.h>
 #include <sys/sendfile.h>
 #include <stdio.h>
@@ -11,13 +12,20 @@
 #include <unistd.h>
 
 #include "config.h"
+#include "export.h"
+#include "monitor.h"
+#include "present.h"
+#include "sampling.h"
 #include "util.h"
 
-#define MAX_PATH_SIZE 4096
+/* Sizes past 1 TiB are typos, and would not fit a size_t once in bytes */
+#define MAX_MIB 1048576.0f
 
 Config get_default_config();
-void parse_config(Config *, FILE *);
+bool parse_config(Config *, FILE *);
 int parse_bool(char *arg);
+static bool find_shader(char *, const char *, const char *);
+static bool parse_mib(const char *, float *, bool);
 
 Config
 get_default_config()
@@ -30,88 +38,119 @@ get_default_config()
         .scroll_speed = 1.5,
         .key_move_speed = 400.0,
         .windowed = false,
+        .zero_copy = false,
+        .upload_limit = 32.0,
+        .live = false,
+        .live_upload_limit = 8.0,
+        .monitor = MONITOR_ALL,
+        .present_mode = PRESENT_VSYNC,
+        .mipmaps = true,
+        .low_memory = false,
+        .minify = MINIFY_TRILINEAR,
+        .magnify = MAGNIFY_NEAREST,
+        .anisotropy = 1.0,
+        .filters = "none",
+        .snapshot_format = SNAPSHOT_PNG,
+        .snapshot_dir = "",
+        .history_limit = 0.0,
+        .vram_limit = 256.0,
 
         /* Set in code */
-        .vertex_shader_file = NULL,
-        .fragment_shader_file = NULL,
+        .vertex_shader_file = "",
+        .fragment_shader_file = "",
+        .filter_shader_file = "",
     };
 }
 
-Config
-load_config()
+/* The user's configuration directory, $XDG_CONFIG_HOME/zooc. It is created
+ * when missing.
+ */
+bool
+config_dir(char *dir, size_t size)
 {
     const char *xdg_config_home = getenv("XDG_CONFIG_HOME");
-    if (xdg_config_home == NULL) {
-        const char *home = getenv("HOME");
-        if (home == NULL)
-            die("Error: HOME environment variable not set!\n");
-
-        xdg_config_home = malloc(strlen(home) + strlen("/.config") + 1);
-        if (xdg_config_home == NULL)
-            die("Malloc failed to allocate:");
-
-        /* malloc already is guaranteed to return enough bytes, so no snprintf
-         * is needed
-         */
-        sprintf((char *)xdg_config_home, "%s/.config", home);
-    }
+    const char *home = getenv("HOME");
 
-    /* To avoid truncation, we subtract 15 bytes here, allowing for appending
-     * different file suffixes without truncation.
-     */
-    char config_dir[MAX_PATH_SIZE - 15];
-    snprintf(config_dir, sizeof(config_dir), "%s/zooc", xdg_config_home);
-    if (mkdir(config_dir, 0755) == -1 && errno != EEXIST) {
-        if (xdg_config_home && xdg_config_home != getenv("XDG_CONFIG_HOME"))
-            free((void *)xdg_config_home);
-        die("Failed to create directory '%s': %s:", xdg_config_home);
+    if (xdg_config_home != NULL && *xdg_config_home) {
+        snprintf(dir, size, "%s/zooc", xdg_config_home);
+    } else if (home != NULL) {
+        snprintf(dir, size, "%s/.config/zooc", home);
+    } else {
+        fprintf(stderr, "Error: HOME environment variable not set!\n");
+        return false;
     }
 
-    char config_file[MAX_PATH_SIZE];
-    snprintf(config_file, MAX_PATH_SIZE, "%s/config.conf", config_dir);
-
-    if (access(config_file, F_OK | R_OK)) {
-        strncpy(config_file, "/etc/zooc/config.conf", sizeof(config_file));
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create directory '%s': %s\n", dir, strerror(errno));
+        return false;
     }
+    return true;
+}
 
-    FILE *f = fopen(config_file, "r");
-    if (f == NULL)
-        die("Unable to open config file: %s\n", config_file);
+/* Look for a shader in the configuration directory, then in /etc/zooc */
+static bool
+find_shader(char *path, const char *dir, const char *name)
+{
+    snprintf(path, CONFIG_PATH_SIZE, "%s/%s", dir, name);
+    if (!access(path, R_OK))
+        return true;
 
-    char *vertex_shader_file   = malloc(MAX_PATH_SIZE);
-    char *fragment_shader_file = malloc(MAX_PATH_SIZE);
+    snprintf(path, CONFIG_PATH_SIZE, "/etc/zooc/%s", name);
+    if (!access(path, R_OK))
+        return true;
 
-    snprintf(fragment_shader_file, MAX_PATH_SIZE, "%s/fragment.glsl", config_dir);
-    snprintf(vertex_shader_file, MAX_PATH_SIZE, "%s/vertex.glsl", config_dir);
+    fprintf(stderr, "Unable to open shader file at '%s'.\n"
+        "Hint: run 'make install' to create these files.\n", path);
+    return false;
+}
 
-    char message[] = "Unable to open shader file at '%s'.\n%s";
-    char hint[]    = "Hint: run 'make install' to create these files.\n";
+/* Load the configuration into `out`. Nothing is changed when it can't be
+ * read or has errors, so a running zooc keeps its current configuration.
+ */
+bool
+load_config(Config *out)
+{
+    /* Room is left for the file names appended below */
+    char dir[CONFIG_PATH_SIZE - 32];
+    if (!config_dir(dir, sizeof(dir)))
+        return false;
 
-    if (!fopen(vertex_shader_file, "r")) {
-        strncpy(vertex_shader_file, "/etc/zooc/vertex.glsl\0", MAX_PATH_SIZE);
-        if (!fopen(vertex_shader_file, "r"))
-            die(message, vertex_shader_file, hint);
-    }
+    char config_file[CONFIG_PATH_SIZE];
+    snprintf(config_file, sizeof(config_file), "%s/config.conf", dir);
 
-    if (!fopen(fragment_shader_file, "r")) {
-        strncpy(fragment_shader_file, "/etc/zooc/fragment.glsl\0", MAX_PATH_SIZE);
-        if (!fopen(fragment_shader_file, "r"))
-            die(message, fragment_shader_file, hint);
+    if (access(config_file, F_OK | R_OK)) {
+        strncpy(config_file, "/etc/zooc/config.conf", sizeof(config_file));
     }
 
     Config conf = get_default_config();
-    conf.fragment_shader_file = fragment_shader_file;
-    conf.vertex_shader_file = vertex_shader_file;
+    if (!find_shader(conf.vertex_shader_file, dir, "vertex.glsl")
+        || !find_shader(conf.fragment_shader_file, dir, "fragment.glsl"))
+        return false;
+
+    FILE *f = fopen(config_file, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open config file: %s\n", config_file);
+        return false;
+    }
 
-    parse_config(&conf, f);
-    return conf;
+    bool ok = parse_config(&conf, f);
+    fclose(f);
+
+    /* filters.glsl is only needed by those who use filters */
+    if (ok && strcmp(conf.filters, "none"))
+        ok = find_shader(conf.filter_shader_file, dir, "filters.glsl");
+
+    if (ok)
+        *out = conf;
+    return ok;
 }
 
-void
+bool
 parse_config(Config *conf, FILE *f)
 {
     char *line = NULL;
     size_t len = 0;
+    bool ok = true;
 
     size_t cur_line = 1;
     while (getline(&line, &len, f) != -1) {
@@ -130,8 +169,11 @@ parse_config(Config *conf, FILE *f)
              * users can format as they like (though the default uses =)
              */
             c = strtok(NULL, " \t=");
-            if (c == NULL)
-                die(NULL, "Expected value for argument %s\n", arg);
+            if (c == NULL) {
+                fprintf(stderr, "Line %zu: expected value for argument %s\n", cur_line, arg);
+                ok = false;
+                break;
+            }
 
             if (!strcmp(arg, "min_scale")) {
                 conf->min_scale = strtof(c, NULL);
@@ -149,8 +191,91 @@ parse_config(Config *conf, FILE *f)
                 if(parse_bool(c) != -1) {
                     conf->windowed = (bool)parse_bool(c);
                 }
+            } else if (!strcmp(arg, "zero_copy")) {
+                if(parse_bool(c) != -1) {
+                    conf->zero_copy = (bool)parse_bool(c);
+                }
+            } else if (!strcmp(arg, "upload_limit")) {
+                if (!parse_mib(c, &conf->upload_limit, false)) {
+                    fprintf(stderr, "Line %zu: %s must be a positive number of MiB\n", cur_line, arg);
+                    ok = false;
+                }
+            } else if (!strcmp(arg, "live")) {
+                if(parse_bool(c) != -1) {
+                    conf->live = (bool)parse_bool(c);
+                }
+            } else if (!strcmp(arg, "live_upload_limit")) {
+                if (!parse_mib(c, &conf->live_upload_limit, false)) {
+                    fprintf(stderr, "Line %zu: %s must be a positive number of MiB\n", cur_line, arg);
+                    ok = false;
+                }
+            } else if (!strcmp(arg, "monitor")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                if (!strcmp(c, "all"))
+                    conf->monitor = MONITOR_ALL;
+                else if (!strcmp(c, "pointer"))
+                    conf->monitor = MONITOR_POINTER;
+                else
+                    conf->monitor = MAX(0, (int)strtol(c, NULL, 10));
+            } else if (!strcmp(arg, "present_mode")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                for (int i = 0; i < PRESENT_MODE_COUNT; i++) {
+                    if (!strcmp(c, present_mode_name(i)))
+                        conf->present_mode = i;
+                }
+            } else if (!strcmp(arg, "minify")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                for (int i = 0; i < MINIFY_COUNT; i++) {
+                    if (!strcmp(c, minify_name(i)))
+                        conf->minify = i;
+                }
+            } else if (!strcmp(arg, "magnify")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                for (int i = 0; i < MAGNIFY_COUNT; i++) {
+                    if (!strcmp(c, magnify_name(i)))
+                        conf->magnify = i;
+                }
+            } else if (!strcmp(arg, "anisotropy")) {
+                conf->anisotropy = strtof(c, NULL);
+            } else if (!strcmp(arg, "filters")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                if (strlen(c) >= sizeof(conf->filters)) {
+                    fprintf(stderr, "Line %zu: too many filters\n", cur_line);
+                    ok = false;
+                } else {
+                    strcpy(conf->filters, c);
+                }
+            } else if (!strcmp(arg, "snapshot_format")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                for (int i = 0; i < SNAPSHOT_FORMAT_COUNT; i++) {
+                    if (!strcmp(c, snapshot_format_name(i)))
+                        conf->snapshot_format = i;
+                }
+            } else if (!strcmp(arg, "snapshot_dir")) {
+                c[strcspn(c, "\r\n")] = '\0';
+                snprintf(conf->snapshot_dir, sizeof(conf->snapshot_dir), "%s", c);
+            } else if (!strcmp(arg, "history_limit")) {
+                /* 0 turns the history off */
+                if (!parse_mib(c, &conf->history_limit, true)) {
+                    fprintf(stderr, "Line %zu: %s must be 0 or a positive number of MiB\n", cur_line, arg);
+                    ok = false;
+                }
+            } else if (!strcmp(arg, "vram_limit")) {
+                if (!parse_mib(c, &conf->vram_limit, false)) {
+                    fprintf(stderr, "Line %zu: %s must be a positive number of MiB\n", cur_line, arg);
+                    ok = false;
+                }
+            } else if (!strcmp(arg, "mipmaps")) {
+                if(parse_bool(c) != -1) {
+                    conf->mipmaps = (bool)parse_bool(c);
+                }
+            } else if (!strcmp(arg, "low_memory")) {
+                if(parse_bool(c) != -1) {
+                    conf->low_memory = (bool)parse_bool(c);
+                }
             } else {
-                die("Unexpected configuration key '%s'\n", arg);
+                fprintf(stderr, "Line %zu: unexpected configuration key '%s'\n", cur_line, arg);
+                ok = false;
             }
 
             /* get next arg */
@@ -159,7 +284,24 @@ parse_config(Config *conf, FILE *f)
         cur_line++;
     }
 
-    fclose(f);
+    free(line);
+    return ok;
+}
+
+/* A size in MiB, greater than zero, or zero as well with `zero`, and at
+ * most MAX_MIB
+ */
+static bool
+parse_mib(const char *arg, float *out, bool zero)
+{
+    char *end;
+    float mib = strtof(arg, &end);
+
+    if (end == arg || !isfinite(mib) || mib < 0.0f || (mib == 0.0f && !zero)
+        || mib > MAX_MIB)
+        return false;
+    *out = mib;
+    return true;
 }
 
 int
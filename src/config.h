@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#define CONFIG_PATH_SIZE 4096
+#define CONFIG_FILTERS_SIZE 256
+
 typedef struct {
     float min_scale;
     float max_scale;
@@ -12,11 +15,29 @@ typedef struct {
     float scroll_speed;
     float key_move_speed;
     bool windowed;
+    bool zero_copy;
+    float upload_limit;
+    bool live;
+    float live_upload_limit;
+    int monitor;
+    int present_mode;
+    bool mipmaps;
+    bool low_memory;
+    int minify;
+    int magnify;
+    float anisotropy;
+    char filters[CONFIG_FILTERS_SIZE];
+    int snapshot_format;
+    char snapshot_dir[CONFIG_PATH_SIZE];
+    float history_limit;
+    float vram_limit;
 
-    char *fragment_shader_file;
-    char *vertex_shader_file;
+    char fragment_shader_file[CONFIG_PATH_SIZE];
+    char vertex_shader_file[CONFIG_PATH_SIZE];
+    char filter_shader_file[CONFIG_PATH_SIZE];
 } Config;
 
-Config load_config();
+bool config_dir(char *, size_t);
+bool load_config(Config *);
 
 #endif
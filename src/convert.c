@@ -0,0 +1,648 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86
+#include <immintrin.h>
+#endif
+
+#include "convert.h"
+#include "util.h"
+
+/* Rows of one band are converted by a single thread, bands smaller than
+ * this aren't worth handing to another one.
+ */
+#define BAND_BYTES          (256 << 10)
+#define MAX_THREADS         16
+#define ALPHA               0xff000000u
+
+#define BENCH_WIDTH         3840
+#define BENCH_HEIGHT        2160
+#define BENCH_DEFAULT_ITERATIONS 20
+
+/* Converts `width` pixels of one row to BGRA */
+typedef void (*ConvertFn)(const PixelFormat *, uint32_t *, const unsigned char *, int);
+
+typedef enum {
+    ISA_SCALAR,
+    ISA_SSE2,
+    ISA_SSSE3,
+    ISA_AVX2,
+    ISA_COUNT,
+} Isa;
+
+typedef struct {
+    PixelLayout layout;
+    Isa isa;
+    ConvertFn fn;
+} Kernel;
+
+typedef struct {
+    ConvertFn fn;
+    const PixelFormat *format;
+    unsigned char *dst;
+    size_t dst_stride;
+    const unsigned char *src;
+    size_t src_stride;
+    int width;
+    int height;
+    int band_rows;
+} Job;
+
+/* Where a channel sits in a pixel and how wide it is */
+typedef struct {
+    uint32_t mask;
+    int shift;
+    int bits;
+} Channel;
+
+static uint32_t load(const unsigned char *, int, bool);
+static Channel channel(unsigned long);
+static uint32_t scale(uint32_t, Channel);
+static void bgrx8888_scalar(const PixelFormat *, uint32_t *, const unsigned char *, int);
+static void rgb565_scalar(const PixelFormat *, uint32_t *, const unsigned char *, int);
+static void bgr888_scalar(const PixelFormat *, uint32_t *, const unsigned char *, int);
+static void xrgb2101010_scalar(const PixelFormat *, uint32_t *, const unsigned char *, int);
+static void generic_scalar(const PixelFormat *, uint32_t *, const unsigned char *, int);
+static bool isa_supported(Isa);
+static void select_kernels(void);
+static void convert_band(Job *, int);
+static void take_band(void);
+static void *worker(void *);
+static void start_pool(void);
+
+static const char *layout_names[LAYOUT_COUNT] = {
+    [LAYOUT_BGRX8888]    = "bgrx8888",
+    [LAYOUT_RGB565]      = "rgb565",
+    [LAYOUT_BGR888]      = "bgr888",
+    [LAYOUT_XRGB2101010] = "xrgb2101010",
+    [LAYOUT_GENERIC]     = "generic",
+};
+
+static const char *isa_names[ISA_COUNT] = {
+    [ISA_SCALAR] = "scalar",
+    [ISA_SSE2]   = "sse2",
+    [ISA_SSSE3]  = "ssse3",
+    [ISA_AVX2]   = "avx2",
+};
+
+/* The scalar kernels are the reference the vector ones have to match */
+
+/* A pixel of `size` bytes in the image's byte order */
+static uint32_t
+load(const unsigned char *p, int size, bool msb_first)
+{
+    uint32_t v = 0;
+
+    for (int i = 0; i < size; i++) {
+        if (msb_first)
+            v = v << 8 | p[i];
+        else
+            v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static Channel
+channel(unsigned long mask)
+{
+    if (mask == 0)
+        return (Channel) {0, 0, 0};
+    return (Channel) {mask, __builtin_ctzl(mask), __builtin_popcountl(mask)};
+}
+
+/* Narrow channels repeat their top bits, like the fixed kernels do */
+static uint32_t
+scale(uint32_t pixel, Channel c)
+{
+    uint32_t v = (pixel & c.mask) >> c.shift;
+
+    if (c.bits == 0)
+        return 0;
+    if (c.bits >= 8)
+        return v >> (c.bits - 8);
+    if (c.bits >= 4)
+        return v << (8 - c.bits) | v >> (2 * c.bits - 8);
+    return v * 255 / ((1u << c.bits) - 1);
+}
+
+static void
+bgrx8888_scalar(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    UNUSED(f);
+    for (int i = 0; i < width; i++) {
+        uint32_t p;
+        memcpy(&p, src + 4 * i, sizeof(p));
+        dst[i] = p | ALPHA;
+    }
+}
+
+static void
+rgb565_scalar(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    UNUSED(f);
+    for (int i = 0; i < width; i++) {
+        uint16_t p;
+        memcpy(&p, src + 2 * i, sizeof(p));
+
+        uint32_t r = p >> 11, g = (p >> 5) & 0x3f, b = p & 0x1f;
+        r = r << 3 | r >> 2;
+        g = g << 2 | g >> 4;
+        b = b << 3 | b >> 2;
+        dst[i] = ALPHA | r << 16 | g << 8 | b;
+    }
+}
+
+static void
+bgr888_scalar(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    UNUSED(f);
+    for (int i = 0; i < width; i++, src += 3)
+        dst[i] = ALPHA | (uint32_t)src[2] << 16 | (uint32_t)src[1] << 8 | src[0];
+}
+
+/* Only the top 8 of each 10 bits make it into the texture */
+static void
+xrgb2101010_scalar(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    UNUSED(f);
+    for (int i = 0; i < width; i++) {
+        uint32_t p;
+        memcpy(&p, src + 4 * i, sizeof(p));
+        dst[i] = ALPHA | ((p >> 6) & 0xff0000) | ((p >> 4) & 0xff00) | ((p >> 2) & 0xff);
+    }
+}
+
+static void
+generic_scalar(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    Channel r = channel(f->red_mask), g = channel(f->green_mask), b = channel(f->blue_mask);
+
+    for (int i = 0; i < width; i++, src += f->bytes_per_pixel) {
+        uint32_t p = load(src, f->bytes_per_pixel, f->msb_first);
+        dst[i] = ALPHA | scale(p, r) << 16 | scale(p, g) << 8 | scale(p, b);
+    }
+}
+
+#ifdef CONVERT_X86
+__attribute__((target("sse2")))
+static void
+bgrx8888_sse2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m128i alpha = _mm_set1_epi32((int)ALPHA);
+    int i = 0;
+
+    for (; i + 4 <= width; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(p, alpha));
+    }
+    bgrx8888_scalar(f, dst + i, src + 4 * i, width - i);
+}
+
+__attribute__((target("avx2")))
+static void
+bgrx8888_avx2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m256i alpha = _mm256_set1_epi32((int)ALPHA);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(p, alpha));
+    }
+    bgrx8888_scalar(f, dst + i, src + 4 * i, width - i);
+}
+
+/* Channels are widened in 16 bit lanes, then blue and green are interleaved
+ * with red and alpha into whole pixels.
+ */
+__attribute__((target("sse2")))
+static void
+rgb565_sse2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    const __m128i alpha = _mm_set1_epi16((short)0xff00);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+        __m128i b = _mm_and_si128(p, mask5);
+
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+        __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        __m128i ra = _mm_or_si128(r, alpha);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+    rgb565_scalar(f, dst + i, src + 2 * i, width - i);
+}
+
+/* As the SSE2 kernel, the unpacks work within 128 bit lanes so the halves
+ * are put back in order before they are stored.
+ */
+__attribute__((target("avx2")))
+static void
+rgb565_avx2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m256i mask5 = _mm256_set1_epi16(0x1f);
+    const __m256i mask6 = _mm256_set1_epi16(0x3f);
+    const __m256i alpha = _mm256_set1_epi16((short)0xff00);
+    int i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i r = _mm256_srli_epi16(p, 11);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi16(p, 5), mask6);
+        __m256i b = _mm256_and_si256(p, mask5);
+
+        r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+        g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+        b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+
+        __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+        __m256i ra = _mm256_or_si256(r, alpha);
+        __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+        __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    rgb565_scalar(f, dst + i, src + 2 * i, width - i);
+}
+
+/* Spreading three bytes over four needs a byte shuffle, which SSE2 lacks.
+ * Loads are 16 bytes wide, so the last pixels of a row are left to the
+ * scalar kernel rather than reading past its end.
+ */
+__attribute__((target("ssse3")))
+static void
+bgr888_ssse3(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m128i shuffle = _mm_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)ALPHA);
+    int i = 0;
+
+    for (; i + 6 <= width; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        p = _mm_shuffle_epi8(p, shuffle);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(p, alpha));
+    }
+    bgr888_scalar(f, dst + i, src + 3 * i, width - i);
+}
+
+__attribute__((target("avx2")))
+static void
+bgr888_avx2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int)ALPHA);
+    int i = 0;
+
+    for (; i + 10 <= width; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + 3 * i + 12));
+        __m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        p = _mm256_shuffle_epi8(p, shuffle);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(p, alpha));
+    }
+    bgr888_scalar(f, dst + i, src + 3 * i, width - i);
+}
+
+__attribute__((target("sse2")))
+static void
+xrgb2101010_sse2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m128i red = _mm_set1_epi32(0xff0000);
+    const __m128i green = _mm_set1_epi32(0xff00);
+    const __m128i blue = _mm_set1_epi32(0xff);
+    const __m128i alpha = _mm_set1_epi32((int)ALPHA);
+    int i = 0;
+
+    for (; i + 4 <= width; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 6), red),
+                _mm_and_si128(_mm_srli_epi32(p, 4), green)),
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 2), blue), alpha));
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+    xrgb2101010_scalar(f, dst + i, src + 4 * i, width - i);
+}
+
+__attribute__((target("avx2")))
+static void
+xrgb2101010_avx2(const PixelFormat *f, uint32_t *dst, const unsigned char *src, int width)
+{
+    const __m256i red = _mm256_set1_epi32(0xff0000);
+    const __m256i green = _mm256_set1_epi32(0xff00);
+    const __m256i blue = _mm256_set1_epi32(0xff);
+    const __m256i alpha = _mm256_set1_epi32((int)ALPHA);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+        __m256i out = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p, 6), red),
+                _mm256_and_si256(_mm256_srli_epi32(p, 4), green)),
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p, 2), blue), alpha));
+        _mm256_storeu_si256((__m256i *)(dst + i), out);
+    }
+    xrgb2101010_scalar(f, dst + i, src + 4 * i, width - i);
+}
+#endif
+
+/* From slowest to fastest, the last supported kernel of a layout is used */
+static const Kernel kernels[] = {
+    { LAYOUT_BGRX8888,    ISA_SCALAR, bgrx8888_scalar },
+    { LAYOUT_RGB565,      ISA_SCALAR, rgb565_scalar },
+    { LAYOUT_BGR888,      ISA_SCALAR, bgr888_scalar },
+    { LAYOUT_XRGB2101010, ISA_SCALAR, xrgb2101010_scalar },
+    { LAYOUT_GENERIC,     ISA_SCALAR, generic_scalar },
+#ifdef CONVERT_X86
+    { LAYOUT_BGRX8888,    ISA_SSE2,   bgrx8888_sse2 },
+    { LAYOUT_RGB565,      ISA_SSE2,   rgb565_sse2 },
+    { LAYOUT_BGR888,      ISA_SSSE3,  bgr888_ssse3 },
+    { LAYOUT_XRGB2101010, ISA_SSE2,   xrgb2101010_sse2 },
+    { LAYOUT_BGRX8888,    ISA_AVX2,   bgrx8888_avx2 },
+    { LAYOUT_RGB565,      ISA_AVX2,   rgb565_avx2 },
+    { LAYOUT_BGR888,      ISA_AVX2,   bgr888_avx2 },
+    { LAYOUT_XRGB2101010, ISA_AVX2,   xrgb2101010_avx2 },
+#endif
+};
+
+static ConvertFn selected[LAYOUT_COUNT];
+static pthread_once_t selected_once = PTHREAD_ONCE_INIT;
+
+/* Rows are split into bands that the pool's threads and the caller take
+ * one at a time.
+ */
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int threads;
+
+    Job job;
+    int bands;
+    int next_band;
+    int pending;
+} pool = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static bool
+isa_supported(Isa isa)
+{
+    switch (isa) {
+    case ISA_SCALAR:
+        return true;
+#ifdef CONVERT_X86
+    case ISA_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case ISA_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static void
+select_kernels(void)
+{
+#ifdef CONVERT_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t i = 0; i < LENGTH(kernels); i++) {
+        if (isa_supported(kernels[i].isa))
+            selected[kernels[i].layout] = kernels[i].fn;
+    }
+}
+
+/* Work out which kernel handles the pixels of `img` */
+void
+pixel_format(PixelFormat *f, const XImage *img)
+{
+    uint16_t one = 1;
+    int host_order = *(unsigned char *)&one ? LSBFirst : MSBFirst;
+    bool native = img->byte_order == host_order;
+
+    *f = (PixelFormat) {
+        .layout = LAYOUT_GENERIC,
+        .bytes_per_pixel = img->bits_per_pixel / 8,
+        .red_mask = img->red_mask,
+        .green_mask = img->green_mask,
+        .blue_mask = img->blue_mask,
+        .msb_first = img->byte_order == MSBFirst,
+    };
+
+    if (img->bits_per_pixel == 32 && native && img->red_mask == 0xff0000
+        && img->green_mask == 0xff00 && img->blue_mask == 0xff)
+        f->layout = LAYOUT_BGRX8888;
+    else if (img->bits_per_pixel == 32 && native && img->red_mask == 0x3ff00000
+        && img->green_mask == 0xffc00 && img->blue_mask == 0x3ff)
+        f->layout = LAYOUT_XRGB2101010;
+    else if (img->bits_per_pixel == 16 && native && img->red_mask == 0xf800
+        && img->green_mask == 0x7e0 && img->blue_mask == 0x1f)
+        f->layout = LAYOUT_RGB565;
+    else if (img->bits_per_pixel == 24 && img->byte_order == LSBFirst
+        && img->red_mask == 0xff0000 && img->green_mask == 0xff00 && img->blue_mask == 0xff)
+        f->layout = LAYOUT_BGR888;
+}
+
+const char *
+layout_name(PixelLayout layout)
+{
+    return layout_names[layout];
+}
+
+static void
+convert_band(Job *job, int band)
+{
+    int first = band * job->band_rows;
+    int last = MIN(first + job->band_rows, job->height);
+
+    for (int y = first; y < last; y++) {
+        job->fn(job->format, (uint32_t *)(job->dst + (size_t)y * job->dst_stride),
+            job->src + (size_t)y * job->src_stride, job->width);
+    }
+}
+
+/* Convert the next band, called with the lock held */
+static void
+take_band(void)
+{
+    int band = pool.next_band++;
+    Job job = pool.job;
+
+    pthread_mutex_unlock(&pool.lock);
+    convert_band(&job, band);
+    pthread_mutex_lock(&pool.lock);
+
+    if (--pool.pending == 0)
+        pthread_cond_signal(&pool.done);
+}
+
+static void *
+worker(void *arg)
+{
+    UNUSED(arg);
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.next_band >= pool.bands)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        take_band();
+    }
+    return NULL;
+}
+
+/* One thread per core besides the caller, they live as long as zooc */
+static void
+start_pool(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = CLAMP(0, (int)cores - 1, MAX_THREADS);
+
+    for (int i = 0; i < wanted; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0)
+            break;
+        pthread_detach(thread);
+        pool.threads++;
+    }
+}
+
+/* Convert `height` rows of `width` pixels into BGRA, the layout textures
+ * are uploaded in. Large conversions are spread over all cores in bands of
+ * rows. Only one thread may convert at a time.
+ */
+void
+convert_rows(const PixelFormat *f, void *dst, size_t dst_stride,
+        const void *src, size_t src_stride, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    pthread_once(&selected_once, select_kernels);
+
+    Job job = {
+        .fn = selected[f->layout],
+        .format = f,
+        .dst = dst,
+        .dst_stride = dst_stride,
+        .src = src,
+        .src_stride = src_stride,
+        .width = width,
+        .height = height,
+        .band_rows = MAX(1, BAND_BYTES / (width * 4)),
+    };
+    int bands = (height + job.band_rows - 1) / job.band_rows;
+
+    if (bands == 1) {
+        convert_band(&job, 0);
+        return;
+    }
+
+    pthread_once(&pool.once, start_pool);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.job = job;
+    pool.bands = bands;
+    pool.next_band = 0;
+    pool.pending = bands;
+    pthread_cond_broadcast(&pool.start);
+
+    while (pool.next_band < pool.bands)
+        take_band();
+    while (pool.pending > 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/* Time every kernel the CPU supports on a 4K frame, on one thread and then
+ * through convert_rows on all of them. Throughput counts the BGRA bytes
+ * written.
+ */
+void
+convert_benchmark(int iterations)
+{
+    static const PixelFormat formats[LAYOUT_COUNT] = {
+        [LAYOUT_BGRX8888]    = { LAYOUT_BGRX8888, 4, 0xff0000, 0xff00, 0xff, false },
+        [LAYOUT_RGB565]      = { LAYOUT_RGB565, 2, 0xf800, 0x7e0, 0x1f, false },
+        [LAYOUT_BGR888]      = { LAYOUT_BGR888, 3, 0xff0000, 0xff00, 0xff, false },
+        [LAYOUT_XRGB2101010] = { LAYOUT_XRGB2101010, 4, 0x3ff00000, 0xffc00, 0x3ff, false },
+        [LAYOUT_GENERIC]     = { LAYOUT_GENERIC, 4, 0xff00, 0xff0000, 0xff000000, true },
+    };
+    size_t pixels = (size_t)BENCH_WIDTH * BENCH_HEIGHT;
+
+    if (iterations <= 0)
+        iterations = BENCH_DEFAULT_ITERATIONS;
+
+    unsigned char *src = malloc(pixels * 4);
+    uint32_t *dst = malloc(pixels * 4);
+    if (src == NULL || dst == NULL)
+        die("Malloc failed to allocate:");
+    for (size_t i = 0; i < pixels * 4; i++)
+        src[i] = i * 2654435761u >> 24;
+
+    pthread_once(&selected_once, select_kernels);
+    pthread_once(&pool.once, start_pool);
+
+    printf("converting %dx%d, %d iterations, %d threads\n",
+        BENCH_WIDTH, BENCH_HEIGHT, iterations, pool.threads + 1);
+    printf("%-12s %-8s %10s %10s\n", "layout", "kernel", "min ms", "GB/s");
+
+    for (size_t k = 0; k <= LENGTH(kernels); k++) {
+        for (int l = 0; l < LAYOUT_COUNT; l++) {
+            /* One pass per kernel, then the threaded one per layout */
+            bool threaded = k == LENGTH(kernels);
+            if (!threaded && (kernels[k].layout != (PixelLayout)l || !isa_supported(kernels[k].isa)))
+                continue;
+
+            const PixelFormat *f = &formats[l];
+            size_t stride = (size_t)BENCH_WIDTH * f->bytes_per_pixel;
+            double min = 1e30;
+
+            for (int i = 0; i < iterations; i++) {
+                uint64_t start = now_ns();
+                if (threaded) {
+                    convert_rows(f, dst, BENCH_WIDTH * 4, src, stride, BENCH_WIDTH, BENCH_HEIGHT);
+                } else {
+                    for (int y = 0; y < BENCH_HEIGHT; y++)
+                        kernels[k].fn(f, dst + (size_t)y * BENCH_WIDTH, src + y * stride, BENCH_WIDTH);
+                }
+                min = MIN(min, (now_ns() - start) / 1e6);
+            }
+
+            printf("%-12s %-8s %10.2f %10.2f\n", layout_names[l],
+                threaded ? "threads" : isa_names[kernels[k].isa],
+                min, pixels * 4 / (min / 1e3) / 1e9);
+        }
+    }
+
+    free(src);
+    free(dst);
+}
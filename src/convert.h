@@ -0,0 +1,35 @@
+#ifndef ZOOC_CONVERT_H
+#define ZOOC_CONVERT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <X11/Xlib.h>
+
+/* Pixel layouts of XImages with a kernel of their own, named from the most
+ * significant bit down. Anything else is converted through the masks.
+ */
+typedef enum {
+    LAYOUT_BGRX8888,
+    LAYOUT_RGB565,
+    LAYOUT_BGR888,
+    LAYOUT_XRGB2101010,
+    LAYOUT_GENERIC,
+    LAYOUT_COUNT,
+} PixelLayout;
+
+typedef struct {
+    PixelLayout layout;
+    int bytes_per_pixel;
+    unsigned long red_mask;
+    unsigned long green_mask;
+    unsigned long blue_mask;
+    bool msb_first;
+} PixelFormat;
+
+void pixel_format(PixelFormat *, const XImage *);
+const char *layout_name(PixelLayout);
+void convert_rows(const PixelFormat *, void *, size_t, const void *, size_t, int, int);
+void convert_benchmark(int);
+
+#endif
@@ -0,0 +1,174 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "util.h"
+
+/* A client sends its start time right after connecting, one that doesn't
+ * is not allowed to hold up the render thread any longer than this.
+ */
+#define CLIENT_TIMEOUT_MS   100
+
+static bool private_dir(const char *, bool);
+static bool socket_path(struct sockaddr_un *, bool);
+static int connect_daemon(void);
+
+/* True when `dir` is a directory only we can get into, created first
+ * when `create` is set.
+ */
+static bool
+private_dir(const char *dir, bool create)
+{
+    struct stat st;
+
+    if (create && mkdir(dir, 0700) == -1 && errno != EEXIST)
+        return false;
+    return lstat(dir, &st) == 0 && S_ISDIR(st.st_mode)
+        && st.st_uid == getuid() && (st.st_mode & 077) == 0;
+}
+
+/* One resident zooc per display, its socket lives in $XDG_RUNTIME_DIR.
+ * Without one it goes in a directory of our own in /tmp, anyone could
+ * have made the socket or swapped it had it been in /tmp itself.
+ */
+static bool
+socket_path(struct sockaddr_un *addr, bool create)
+{
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    const char *display = getenv("DISPLAY");
+    char name[64], dir[32];
+
+    snprintf(name, sizeof(name), "%s", display ? display : "");
+    for (char *c = name; *c; c++) {
+        if (*c == '/')
+            *c = '_';
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (runtime != NULL && *runtime) {
+        snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/zooc%s.sock", runtime, name);
+        return true;
+    }
+
+    snprintf(dir, sizeof(dir), "/tmp/zooc-%d", (int)getuid());
+    snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/zooc%s.sock", dir, name);
+    return private_dir(dir, create);
+}
+
+static int
+connect_daemon(void)
+{
+    struct sockaddr_un addr;
+    if (!socket_path(&addr, false))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Listen for activations. A socket nobody answers on was left behind by a
+ * daemon that was killed and is replaced.
+ */
+int
+daemon_listen(void)
+{
+    struct sockaddr_un addr;
+    if (!socket_path(&addr, true))
+        die("Unable to keep the activation socket at '%s', its directory has to "
+            "belong to you and be private\n", addr.sun_path);
+
+    int running = connect_daemon();
+    if (running != -1) {
+        close(running);
+        die("zooc is already resident on this display\n");
+    }
+    unlink(addr.sun_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        die("Unable to create the activation socket:");
+
+    /* Only we may connect */
+    mode_t mask = umask(077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound == -1)
+        die("Unable to bind the activation socket at '%s':", addr.sun_path);
+    if (listen(fd, 4) == -1)
+        die("Unable to listen on the activation socket:");
+
+    return fd;
+}
+
+/* Take the next activation. The client sends the time it was started at,
+ * which the daemon's latency is measured from. Returns -1 on a bad client.
+ */
+int
+daemon_accept(int fd, uint64_t *sent)
+{
+    int client = accept(fd, NULL, NULL);
+    if (client == -1)
+        return -1;
+
+    struct pollfd pfd = { .fd = client, .events = POLLIN };
+    if (poll(&pfd, 1, CLIENT_TIMEOUT_MS) != 1
+        || read(client, sent, sizeof(*sent)) != sizeof(*sent)) {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+/* Tell the client how long it took until the first frame was shown */
+void
+daemon_reply(int client, uint64_t latency)
+{
+    /* A client that gave up must not take the daemon down with SIGPIPE */
+    ssize_t n = send(client, &latency, sizeof(latency), MSG_NOSIGNAL);
+    UNUSED(n);
+    close(client);
+}
+
+/* Ask the resident zooc to show itself and wait for its first frame.
+ * Returns false when no daemon is running.
+ */
+bool
+daemon_activate(bool report)
+{
+    int fd = connect_daemon();
+    if (fd == -1)
+        return false;
+
+    uint64_t sent = now_ns(), latency = 0;
+    if (write(fd, &sent, sizeof(sent)) != sizeof(sent)) {
+        close(fd);
+        return false;
+    }
+
+    /* The daemon answers once the first frame is on its way */
+    ssize_t n = read(fd, &latency, sizeof(latency));
+    close(fd);
+
+    if (report && n == sizeof(latency) && latency == DAEMON_SHOWN)
+        printf("zooc is already shown\n");
+    else if (report && n == sizeof(latency))
+        printf("activation %.2f ms\n", latency / 1e6);
+    return true;
+}
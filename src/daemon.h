@@ -0,0 +1,15 @@
+#ifndef ZOOC_DAEMON_H
+#define ZOOC_DAEMON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Replied instead of a latency when a session is already being shown */
+#define DAEMON_SHOWN    UINT64_MAX
+
+int daemon_listen(void);
+int daemon_accept(int, uint64_t *);
+void daemon_reply(int, uint64_t);
+bool daemon_activate(bool);
+
+#endif
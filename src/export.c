@@ -0,0 +1,596 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "export.h"
+#include "stats.h"
+#include "util.h"
+
+static void collect(Export *, bool);
+static void hand_off(Export *, Readback *);
+static void *encoder_thread(void *);
+static FILE *create_snapshot(const ExportBuffer *, char *, size_t);
+static bool write_ppm(FILE *, const ExportBuffer *);
+static bool write_png(FILE *, const ExportBuffer *);
+static void write_snapshot(const ExportBuffer *);
+static void put_u32(unsigned char *, uint32_t);
+static uint32_t crc32(uint32_t, const unsigned char *, size_t);
+static void to_yuv(Export *, const ExportBuffer *);
+static void write_frame(Export *, const ExportBuffer *);
+static void stop_recording(Export *, const char *);
+
+static const char *format_names[SNAPSHOT_FORMAT_COUNT] = {
+    [SNAPSHOT_PNG] = "png",
+    [SNAPSHOT_PPM] = "ppm",
+};
+
+const char *
+snapshot_format_name(SnapshotFormat format)
+{
+    return format < SNAPSHOT_FORMAT_COUNT ? format_names[format] : "unknown";
+}
+
+/* Prepare for snapshots, and with a `record` path ("-" for stdout) start
+ * writing a Y4M stream at `fps` frames per second.
+ */
+void
+export_init(Export *e, const char *record, float fps)
+{
+    memset(e, 0, sizeof(*e));
+    e->frame_ns = 1e9f / MAX(fps, 1.0f);
+
+    if (record != NULL) {
+        e->stream = strcmp(record, "-") ? fopen(record, "wb") : stdout;
+        if (e->stream == NULL)
+            die("Unable to open '%s' for recording:", record);
+        e->stream_name = record;
+        e->recording = true;
+
+        /* A reader that goes away ends the recording, not zooc */
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    if (pthread_create(&e->thread, NULL, encoder_thread, e) != 0)
+        die("Unable to start the encoder thread\n");
+    e->started = true;
+}
+
+/* A new session starts, time spent away from it isn't recorded */
+void
+export_begin(Export *e)
+{
+    e->last_time = 0;
+}
+
+/* Save the next frame as a snapshot in `dir` */
+void
+export_snapshot(Export *e, SnapshotFormat format, const char *dir)
+{
+    e->snapshot_wanted = true;
+    e->format = format;
+    snprintf(e->dir, sizeof(e->dir), "%s", dir);
+}
+
+/* Hand finished readbacks to the encoder, oldest first. Without `wait`
+ * this stops at the first one the GPU is still working on.
+ */
+static void
+collect(Export *e, bool wait)
+{
+    while (e->in_flight > 0) {
+        Readback *r = &e->readbacks[e->tail];
+        GLenum status = glClientWaitSync(r->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+            wait ? UINT64_MAX : 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            return;
+
+        glDeleteSync(r->fence);
+        r->fence = NULL;
+        hand_off(e, r);
+
+        e->tail = (e->tail + 1) % EXPORT_READBACK_COUNT;
+        e->in_flight--;
+    }
+}
+
+/* Copy a finished readback into a free buffer and queue it. Recorded
+ * frames are dropped when every buffer is still queued, snapshots wait for
+ * one so a key press is never lost.
+ */
+static void
+hand_off(Export *e, Readback *r)
+{
+    ExportBuffer *b = NULL;
+
+    if (r->record && !e->recording)
+        r->record = false;
+    if (!r->record && !r->snapshot)
+        return;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        for (int i = 0; b == NULL && i < EXPORT_BUFFER_COUNT; i++) {
+            if (!e->buffers[i].queued)
+                b = &e->buffers[i];
+        }
+        if (b != NULL || !r->snapshot)
+            break;
+        pthread_cond_wait(&e->cond, &e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    if (b == NULL) {
+        if (e->dropped++ == 0)
+            fprintf(stderr, "The encoder is falling behind, dropping frames\n");
+        stats.export_dropped++;
+        return;
+    }
+
+    size_t size = (size_t)r->width * r->height * 4;
+    if (b->capacity < size) {
+        free(b->pixels);
+        b->pixels = malloc(size);
+        if (b->pixels == NULL)
+            die("Malloc failed to allocate:");
+        b->capacity = size;
+    }
+
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, r->pbo));
+    void *src = GL(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+    if (src != NULL) {
+        memcpy(b->pixels, src, size);
+        GL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+    }
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    if (src == NULL)
+        return;
+
+    b->width = r->width;
+    b->height = r->height;
+    b->snapshot = r->snapshot;
+    b->record = r->record;
+    b->taken = time(NULL);
+    b->format = e->format;
+    snprintf(b->dir, sizeof(b->dir), "%s", e->dir);
+
+    /* Frames that weren't rendered or were dropped since the last one
+     * are made up by repeating it.
+     */
+    b->repeat = 0;
+    if (r->record) {
+        if (e->last_time != 0)
+            b->repeat = MAX(0, (int)((r->time - e->last_time + e->frame_ns / 2) / e->frame_ns) - 1);
+        e->last_time = r->time;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    b->queued = true;
+    e->queue[(e->queue_head + e->queue_count) % EXPORT_BUFFER_COUNT] = b - e->buffers;
+    e->queue_count++;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+}
+
+/* Read back the frame just drawn, `width` x `height` pixels of the back
+ * buffer, when it is to be saved or recorded. Has to be called before the
+ * buffers are swapped. Readbacks of earlier frames that are done by now
+ * are handed to the encoder first.
+ */
+void
+export_frame(Export *e, int width, int height)
+{
+    collect(e, false);
+
+    bool record = e->recording;
+    if (!e->snapshot_wanted && !record)
+        return;
+
+    if (e->in_flight == EXPORT_READBACK_COUNT) {
+        /* The GPU is behind too, only a snapshot is worth waiting for */
+        if (!e->snapshot_wanted) {
+            if (e->dropped++ == 0)
+                fprintf(stderr, "The encoder is falling behind, dropping frames\n");
+            stats.export_dropped++;
+            return;
+        }
+        collect(e, true);
+    }
+
+    Readback *r = &e->readbacks[(e->tail + e->in_flight) % EXPORT_READBACK_COUNT];
+    size_t size = (size_t)width * height * 4;
+
+    if (r->pbo == 0)
+        GL(glGenBuffers(1, &r->pbo));
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, r->pbo));
+    if (r->size < size) {
+        GL(glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ));
+        r->size = size;
+    }
+
+    GL(glReadBuffer(GL_BACK));
+    GL(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+    GL(glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL));
+    GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+    r->fence = GL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    r->width = width;
+    r->height = height;
+    r->time = now_ns();
+    r->snapshot = e->snapshot_wanted;
+    r->record = record;
+
+    e->snapshot_wanted = false;
+    e->in_flight++;
+}
+
+/* Wait for every readback in flight and hand it to the encoder, for when
+ * no more frames are coming for a while.
+ */
+void
+export_flush(Export *e)
+{
+    collect(e, true);
+}
+
+static void *
+encoder_thread(void *arg)
+{
+    Export *e = arg;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (e->queue_count == 0 && !e->quit)
+            pthread_cond_wait(&e->cond, &e->lock);
+        if (e->queue_count == 0)
+            break;
+
+        ExportBuffer *b = &e->buffers[e->queue[e->queue_head]];
+        pthread_mutex_unlock(&e->lock);
+
+        if (b->snapshot)
+            write_snapshot(b);
+        if (b->record && e->stream != NULL)
+            write_frame(e, b);
+
+        pthread_mutex_lock(&e->lock);
+        b->queued = false;
+        e->queue_head = (e->queue_head + 1) % EXPORT_BUFFER_COUNT;
+        e->queue_count--;
+        pthread_cond_broadcast(&e->cond);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+/* Snapshots are named after the time they were taken, a number is added
+ * when there are several within a second. Returns NULL when the file
+ * can't be created.
+ */
+static FILE *
+create_snapshot(const ExportBuffer *b, char *path, size_t size)
+{
+    char stamp[32];
+    struct tm tm;
+
+    localtime_r(&b->taken, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    for (int i = 0; i < 100; i++) {
+        const char *ext = snapshot_format_name(b->format);
+        if (i == 0)
+            snprintf(path, size, "%s/zooc-%s.%s", b->dir, stamp, ext);
+        else
+            snprintf(path, size, "%s/zooc-%s-%d.%s", b->dir, stamp, i, ext);
+
+        FILE *fp = fopen(path, "wbx");
+        if (fp != NULL || errno != EEXIST)
+            return fp;
+    }
+    return NULL;
+}
+
+static bool
+write_ppm(FILE *fp, const ExportBuffer *b)
+{
+    unsigned char *row = malloc((size_t)b->width * 3);
+    bool ok = row != NULL && fprintf(fp, "P6\n%d %d\n255\n", b->width, b->height) > 0;
+
+    for (int y = b->height - 1; ok && y >= 0; y--) {
+        const unsigned char *src = b->pixels + (size_t)y * b->width * 4;
+        for (int x = 0; x < b->width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 2];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 0];
+        }
+        ok = fwrite(row, (size_t)b->width * 3, 1, fp) == 1;
+    }
+    free(row);
+    return ok;
+}
+
+static void
+put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t
+crc32(uint32_t crc, const unsigned char *p, size_t len)
+{
+    static uint32_t table[256];
+
+    /* Only ever called from the encoder thread */
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    while (len--)
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* PNG without compression: the zlib stream holds the rows in stored
+ * blocks, which needs no dependencies and keeps the encoder fast. Any
+ * image tool can recompress them.
+ */
+static bool
+write_png(FILE *fp, const ExportBuffer *b)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    size_t row_bytes = 1 + (size_t)b->width * 3;
+    size_t raw_size = row_bytes * b->height;
+    size_t blocks = (raw_size + 65534) / 65535;
+    size_t idat_size = 2 + raw_size + 5 * blocks + 4;
+    unsigned char *raw = malloc(raw_size);
+    unsigned char head[8 + 13 + 4];
+    bool ok = false;
+
+    if (raw == NULL || idat_size > UINT32_MAX) {
+        free(raw);
+        return false;
+    }
+
+    /* Every row is filtered with None, image rows are bottom up */
+    for (int y = 0; y < b->height; y++) {
+        const unsigned char *src = b->pixels + (size_t)(b->height - 1 - y) * b->width * 4;
+        unsigned char *dst = raw + y * row_bytes;
+
+        *dst++ = 0;
+        for (int x = 0; x < b->width; x++) {
+            *dst++ = src[x * 4 + 2];
+            *dst++ = src[x * 4 + 1];
+            *dst++ = src[x * 4 + 0];
+        }
+    }
+
+    /* IHDR: 8 bit RGB, no interlacing */
+    put_u32(head, 13);
+    memcpy(head + 4, "IHDR", 4);
+    put_u32(head + 8, b->width);
+    put_u32(head + 12, b->height);
+    memcpy(head + 16, (unsigned char[]) { 8, 2, 0, 0, 0 }, 5);
+    put_u32(head + 21, crc32(0, head + 4, 17));
+
+    if (fwrite(signature, sizeof(signature), 1, fp) != 1
+        || fwrite(head, sizeof(head), 1, fp) != 1)
+        goto done;
+
+    unsigned char chunk[8] = { 0 };
+    put_u32(chunk, idat_size);
+    memcpy(chunk + 4, "IDAT", 4);
+    unsigned char zlib[2] = { 0x78, 0x01 };
+    uint32_t crc = crc32(crc32(0, chunk + 4, 4), zlib, 2);
+    if (fwrite(chunk, 8, 1, fp) != 1 || fwrite(zlib, 2, 1, fp) != 1)
+        goto done;
+
+    uint32_t a = 1, s = 0;
+    for (size_t off = 0; off < raw_size; off += 65535) {
+        size_t len = MIN((size_t)65535, raw_size - off);
+        unsigned char block[5] = {
+            off + len == raw_size, len & 0xff, len >> 8, ~len & 0xff, (~len >> 8) & 0xff,
+        };
+
+        for (size_t i = 0; i < len; i++) {
+            a = (a + raw[off + i]) % 65521;
+            s = (s + a) % 65521;
+        }
+        crc = crc32(crc32(crc, block, 5), raw + off, len);
+        if (fwrite(block, 5, 1, fp) != 1 || fwrite(raw + off, len, 1, fp) != 1)
+            goto done;
+    }
+
+    unsigned char tail[4 + 4 + 12];
+    put_u32(tail, (s << 16) | a);
+    put_u32(tail + 4, crc32(crc, tail, 4));
+    put_u32(tail + 8, 0);
+    memcpy(tail + 12, "IEND", 4);
+    put_u32(tail + 16, crc32(0, tail + 12, 4));
+    ok = fwrite(tail, sizeof(tail), 1, fp) == 1;
+
+done:
+    free(raw);
+    return ok;
+}
+
+static void
+write_snapshot(const ExportBuffer *b)
+{
+    char path[EXPORT_PATH_SIZE + 64];
+    FILE *fp = create_snapshot(b, path, sizeof(path));
+
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to save a snapshot in '%s': %s\n", b->dir, strerror(errno));
+        return;
+    }
+
+    bool ok = b->format == SNAPSHOT_PPM ? write_ppm(fp, b) : write_png(fp, b);
+    ok &= fclose(fp) == 0;
+
+    if (ok) {
+        fprintf(stderr, "Saved %s\n", path);
+    } else {
+        fprintf(stderr, "Unable to write %s\n", path);
+        remove(path);
+    }
+}
+
+/* BT.601 limited range 4:2:0 with chroma sited between the luma samples,
+ * the frame cropped or padded with black to the size of the stream.
+ */
+static void
+to_yuv(Export *e, const ExportBuffer *b)
+{
+    int w = e->stream_width, h = e->stream_height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    unsigned char *y_plane = e->yuv;
+    unsigned char *u_plane = y_plane + (size_t)w * h;
+    unsigned char *v_plane = u_plane + (size_t)cw * ch;
+
+    memset(y_plane, 16, (size_t)w * h);
+    memset(u_plane, 128, (size_t)cw * ch * 2);
+
+    int cols = MIN(w, b->width), rows = MIN(h, b->height);
+    for (int y = 0; y < rows; y++) {
+        const unsigned char *src = b->pixels + (size_t)(b->height - 1 - y) * b->width * 4;
+        for (int x = 0; x < cols; x++) {
+            int r = src[x * 4 + 2], g = src[x * 4 + 1], bl = src[x * 4 + 0];
+            y_plane[(size_t)y * w + x] = ((66 * r + 129 * g + 25 * bl + 128) >> 8) + 16;
+        }
+    }
+
+    for (int y = 0; y < (rows + 1) / 2; y++) {
+        for (int x = 0; x < (cols + 1) / 2; x++) {
+            int r = 0, g = 0, bl = 0, n = 0;
+
+            for (int dy = 0; dy < 2 && 2 * y + dy < rows; dy++) {
+                const unsigned char *src = b->pixels
+                    + (size_t)(b->height - 1 - (2 * y + dy)) * b->width * 4;
+                for (int dx = 0; dx < 2 && 2 * x + dx < cols; dx++) {
+                    const unsigned char *p = src + (2 * x + dx) * 4;
+                    r += p[2];
+                    g += p[1];
+                    bl += p[0];
+                    n++;
+                }
+            }
+            r /= n;
+            g /= n;
+            bl /= n;
+            u_plane[(size_t)y * cw + x] = ((-38 * r - 74 * g + 112 * bl + 128) >> 8) + 128;
+            v_plane[(size_t)y * cw + x] = ((112 * r - 94 * g - 18 * bl + 128) >> 8) + 128;
+        }
+    }
+}
+
+/* Append a frame to the Y4M stream, after repeating the previous one for
+ * the frames in between. The first frame decides the size of the stream.
+ */
+static void
+write_frame(Export *e, const ExportBuffer *b)
+{
+    if (e->yuv == NULL) {
+        e->stream_width = b->width;
+        e->stream_height = b->height;
+
+        size_t chroma = (size_t)((b->width + 1) / 2) * ((b->height + 1) / 2);
+        e->yuv = malloc((size_t)b->width * b->height + 2 * chroma);
+        if (e->yuv == NULL)
+            die("Malloc failed to allocate:");
+
+        if (fprintf(e->stream, "YUV4MPEG2 W%d H%d F%llu:1000 Ip A1:1 C420jpeg\n",
+                b->width, b->height,
+                (unsigned long long)((1000000000000ull + e->frame_ns / 2) / e->frame_ns)) < 0) {
+            stop_recording(e, strerror(errno));
+            return;
+        }
+    }
+
+    size_t chroma = (size_t)((e->stream_width + 1) / 2) * ((e->stream_height + 1) / 2);
+    size_t frame_size = (size_t)e->stream_width * e->stream_height + 2 * chroma;
+
+    for (int i = 0; i <= b->repeat; i++) {
+        /* The buffer still holds the previous frame until the last round */
+        if (i == b->repeat)
+            to_yuv(e, b);
+        if (fputs("FRAME\n", e->stream) == EOF
+            || fwrite(e->yuv, frame_size, 1, e->stream) != 1) {
+            stop_recording(e, strerror(errno));
+            return;
+        }
+        e->recorded++;
+    }
+
+    /* Whatever reads the stream sees every frame as soon as it is written */
+    if (fflush(e->stream) == EOF)
+        stop_recording(e, strerror(errno));
+}
+
+static void
+stop_recording(Export *e, const char *why)
+{
+    fprintf(stderr, "Recording to '%s' stopped: %s\n", e->stream_name, why);
+    if (e->stream != stdout)
+        fclose(e->stream);
+    e->stream = NULL;
+    e->recording = false;
+}
+
+/* Finish what is in flight and queued, then report on the recording */
+void
+export_destroy(Export *e)
+{
+    if (!e->started)
+        return;
+
+    export_flush(e);
+
+    pthread_mutex_lock(&e->lock);
+    e->quit = true;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+    pthread_join(e->thread, NULL);
+
+    if (e->stream != NULL) {
+        if (fflush(e->stream) == EOF)
+            fprintf(stderr, "Recording to '%s' failed: %s\n", e->stream_name, strerror(errno));
+        if (e->stream != stdout)
+            fclose(e->stream);
+    }
+    if (e->stream_name != NULL) {
+        fprintf(stderr, "Recorded %llu frames, %llu dropped\n",
+            (unsigned long long)e->recorded, (unsigned long long)e->dropped);
+    }
+
+    for (int i = 0; i < EXPORT_READBACK_COUNT; i++) {
+        if (e->readbacks[i].pbo)
+            glDeleteBuffers(1, &e->readbacks[i].pbo);
+    }
+    for (int i = 0; i < EXPORT_BUFFER_COUNT; i++)
+        free(e->buffers[i].pixels);
+    free(e->yuv);
+
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->cond);
+    memset(e, 0, sizeof(*e));
+}
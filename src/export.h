@@ -0,0 +1,104 @@
+#ifndef ZOOC_EXPORT_H
+#define ZOOC_EXPORT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <GL/gl.h>
+
+#define EXPORT_READBACK_COUNT   3
+#define EXPORT_BUFFER_COUNT     3
+#define EXPORT_PATH_SIZE        4096
+
+typedef enum {
+    SNAPSHOT_PNG,
+    SNAPSHOT_PPM,
+    SNAPSHOT_FORMAT_COUNT,
+} SnapshotFormat;
+
+/* A frame being read back into a pixel buffer object, done once its fence
+ * is signaled.
+ */
+typedef struct {
+    GLuint pbo;
+    size_t size;
+    GLsync fence;
+    int width;
+    int height;
+    uint64_t time;
+    bool snapshot;
+    bool record;
+} Readback;
+
+/* A frame handed to the encoder, bottom row first as GL reads them */
+typedef struct {
+    unsigned char *pixels;
+    size_t capacity;
+    int width;
+    int height;
+    bool snapshot;
+    bool record;
+    int repeat;
+    time_t taken;
+    SnapshotFormat format;
+    char dir[EXPORT_PATH_SIZE];
+    bool queued;
+} ExportBuffer;
+
+/* Snapshots and recordings of what zooc shows. Frames are read back
+ * through a ring of PBOs and only mapped once their fence says the copy is
+ * done, so the render loop never waits on the GPU. Finished frames are
+ * copied into a few buffers and encoded on a thread of their own; when the
+ * encoder falls behind, recorded frames are dropped rather than held up.
+ */
+typedef struct {
+    Readback readbacks[EXPORT_READBACK_COUNT];
+    int tail;
+    int in_flight;
+
+    /* Set by export_snapshot, taken by the next frame */
+    bool snapshot_wanted;
+    SnapshotFormat format;
+    char dir[EXPORT_PATH_SIZE];
+
+    /* Frames are written at a constant rate, the ones zooc didn't render
+     * because nothing changed are repeated.
+     */
+    uint64_t frame_ns;
+    uint64_t last_time;
+
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ExportBuffer buffers[EXPORT_BUFFER_COUNT];
+    int queue[EXPORT_BUFFER_COUNT];
+    int queue_head;
+    int queue_count;
+    bool quit;
+
+    /* Y4M stream, owned by the encoder once started */
+    FILE *stream;
+    const char *stream_name;
+    _Atomic bool recording;
+    int stream_width;
+    int stream_height;
+    unsigned char *yuv;
+
+    uint64_t recorded;
+    uint64_t dropped;
+} Export;
+
+const char *snapshot_format_name(SnapshotFormat);
+void export_init(Export *, const char *, float);
+void export_begin(Export *);
+void export_snapshot(Export *, SnapshotFormat, const char *);
+void export_frame(Export *, int, int);
+void export_flush(Export *);
+void export_destroy(Export *);
+
+#endif
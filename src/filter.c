@@ -0,0 +1,243 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "filter.h"
+#include "shader.h"
+#include "stats.h"
+#include "util.h"
+
+#define NAME_SIZE   32
+
+static bool parse_filter(char *, char *, float *);
+static void allocate_target(GLuint *, int, int);
+static void clear_programs(FilterGraph *);
+
+/* A filter is written as name[:strength], names are what filters.glsl
+ * tests for with FILTER_<NAME> defined.
+ */
+static bool
+parse_filter(char *item, char *name, float *strength)
+{
+    char *colon = strchr(item, ':');
+    *strength = 1.0f;
+
+    if (colon != NULL) {
+        char *end;
+        *colon = '\0';
+        *strength = strtof(colon + 1, &end);
+        if (end == colon + 1 || *end != '\0')
+            return false;
+    }
+
+    size_t len = strlen(item);
+    if (len == 0 || len >= NAME_SIZE)
+        return false;
+
+    for (size_t i = 0; i <= len; i++) {
+        if (item[i] != '\0' && !isalnum((unsigned char)item[i]) && item[i] != '_')
+            return false;
+        name[i] = toupper((unsigned char)item[i]);
+    }
+    return true;
+}
+
+/* Mutable storage with a single level, so mipmaps can be added later */
+static void
+allocate_target(GLuint *id, int width, int height)
+{
+    GL(glGenTextures(1, id));
+    GL(glBindTexture(GL_TEXTURE_2D, *id));
+    GL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+        GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+}
+
+static void
+clear_programs(FilterGraph *g)
+{
+    for (int i = 0; i < g->count; i++)
+        glDeleteProgram(g->programs[i]);
+    g->count = 0;
+}
+
+/* Build the chain described by `spec`, a comma separated list of filters
+ * from `file` (empty or "none" for no filters). The current chain is kept
+ * when any of them fails to build.
+ */
+bool
+filter_graph_load(FilterGraph *g, const char *file, const char *spec)
+{
+    FilterGraph next = { .count = 0 };
+    char buf[256];
+    char *save;
+
+    snprintf(buf, sizeof(buf), "%s", strcmp(spec, "none") ? spec : "");
+    for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char name[NAME_SIZE], defines[64];
+        float strength;
+
+        if (next.count == FILTER_MAX) {
+            fprintf(stderr, "More than %d filters\n", FILTER_MAX);
+            goto fail;
+        }
+        if (!parse_filter(item, name, &strength)) {
+            fprintf(stderr, "Invalid filter '%s'\n", item);
+            goto fail;
+        }
+
+        snprintf(defines, sizeof(defines), "#define FILTER_%s\n", name);
+        GLuint program = shader_program(file, defines);
+        if (program == 0)
+            goto fail;
+
+        /* The strength of a filter never changes once it is built */
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "tex"), 0);
+        glUniform1f(glGetUniformLocation(program, "strength"), strength);
+
+        next.programs[next.count] = program;
+        next.size[next.count] = glGetUniformLocation(program, "size");
+        next.count++;
+    }
+    glUseProgram(0);
+
+    clear_programs(g);
+    memcpy(g->programs, next.programs, sizeof(g->programs));
+    memcpy(g->size, next.size, sizeof(g->size));
+    g->count = next.count;
+    g->generation++;
+
+    /* Scratch textures are kept for chains of two or more and for
+     * cropped runs, both of which come back on the next apply
+     */
+    if (g->count == 0 && g->scratch[0]) {
+        glDeleteTextures(2, g->scratch);
+        g->scratch[0] = g->scratch[1] = 0;
+        g->scratch_width = g->scratch_height = 0;
+    }
+    return true;
+
+fail:
+    glUseProgram(0);
+    clear_programs(&next);
+    return false;
+}
+
+/* Run the chain over `width` x `height` texels of `src` into `*dst`, which
+ * is allocated when it is 0. The caller's framebuffer, viewport and vertex
+ * array are restored, but the bound program and texture are not.
+ */
+void
+filter_graph_apply(FilterGraph *g, GLuint src, int width, int height, GLuint *dst)
+{
+    filter_graph_apply_region(g, src, width, height, 0, 0, width, height, dst);
+}
+
+/* Run the chain over `src_width` x `src_height` texels of `src` but keep
+ * only the `width` x `height` rectangle at `x`, `y`. Texels around the
+ * rectangle feed the neighbourhood filters, so a piece of a larger image
+ * filters the same as the whole of it when it is given an apron of
+ * filter_graph_apron texels.
+ */
+void
+filter_graph_apply_region(FilterGraph *g, GLuint src, int src_width, int src_height,
+    int x, int y, int width, int height, GLuint *dst)
+{
+    GLint viewport[4];
+
+    if (g->count == 0)
+        return;
+
+    if (*dst == 0)
+        allocate_target(dst, width, height);
+
+    /* The last pass renders straight into the output unless it is cropped */
+    bool crop = x != 0 || y != 0 || width != src_width || height != src_height;
+    if ((g->count > 1 || crop)
+        && (g->scratch_width < src_width || g->scratch_height < src_height)) {
+        int w = MAX(src_width, g->scratch_width);
+        int h = MAX(src_height, g->scratch_height);
+
+        if (g->scratch[0])
+            glDeleteTextures(2, g->scratch);
+        allocate_target(&g->scratch[0], w, h);
+        allocate_target(&g->scratch[1], w, h);
+        g->scratch_width = w;
+        g->scratch_height = h;
+    }
+
+    if (g->fbo == 0) {
+        glGenFramebuffers(1, &g->fbo);
+        glGenVertexArrays(1, &g->vao);
+    }
+
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, g->fbo));
+    GL(glViewport(0, 0, src_width, src_height));
+    GL(glBindVertexArray(g->vao));
+
+    GLuint in = src;
+    for (int i = 0; i < g->count; i++) {
+        GLuint out = i == g->count - 1 && !crop ? *dst : g->scratch[i % 2];
+
+        GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, out, 0));
+        GL(glUseProgram(g->programs[i]));
+        GL(glUniform2f(g->size[i], src_width, src_height));
+        GL(glBindTexture(GL_TEXTURE_2D, in));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        in = out;
+    }
+
+    /* The last scratch is still attached and read from */
+    if (crop) {
+        GL(glBindTexture(GL_TEXTURE_2D, *dst));
+        GL(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, width, height));
+    }
+
+    GL(glBindVertexArray(0));
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    GL(glViewport(viewport[0], viewport[1], viewport[2], viewport[3]));
+}
+
+/* Texels around a region the chain needs to filter it like the whole image */
+int
+filter_graph_apron(const FilterGraph *g)
+{
+    return g->count * FILTER_RADIUS;
+}
+
+/* GPU memory held by the scratch textures, outputs belong to the caller */
+size_t
+filter_graph_bytes(const FilterGraph *g)
+{
+    return g->scratch[0] ? 2 * (size_t)g->scratch_width * g->scratch_height * 4 : 0;
+}
+
+void
+filter_graph_destroy(FilterGraph *g)
+{
+    unsigned int generation = g->generation;
+
+    clear_programs(g);
+    if (g->scratch[0])
+        glDeleteTextures(2, g->scratch);
+    if (g->fbo) {
+        glDeleteFramebuffers(1, &g->fbo);
+        glDeleteVertexArrays(1, &g->vao);
+    }
+
+    /* Outputs made before must still look stale to a chain built later */
+    memset(g, 0, sizeof(*g));
+    g->generation = generation;
+}
@@ -0,0 +1,44 @@
+#ifndef ZOOC_FILTER_H
+#define ZOOC_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <GL/gl.h>
+
+#define FILTER_MAX      8
+
+/* Texels a filter reads on each side of the one it writes, filters.glsl
+ * must stay within it
+ */
+#define FILTER_RADIUS   1
+
+/* A chain of filters from filters.glsl, run over the screenshot into
+ * textures of their own whenever it changes, so drawing a frame stays a
+ * single texture fetch however long the chain is. Each pass renders into
+ * one of two scratch textures, the last one into the output, or into a
+ * scratch texture the kept region is copied from.
+ */
+typedef struct {
+    int count;
+    GLuint programs[FILTER_MAX];
+    GLint size[FILTER_MAX];
+
+    /* Changes whenever the chain does, outputs of an older one are stale */
+    unsigned int generation;
+
+    GLuint fbo;
+    GLuint vao;
+    GLuint scratch[2];
+    int scratch_width;
+    int scratch_height;
+} FilterGraph;
+
+bool filter_graph_load(FilterGraph *, const char *, const char *);
+void filter_graph_apply(FilterGraph *, GLuint, int, int, GLuint *);
+void filter_graph_apply_region(FilterGraph *, GLuint, int, int, int, int, int, int, GLuint *);
+int filter_graph_apron(const FilterGraph *);
+size_t filter_graph_bytes(const FilterGraph *);
+void filter_graph_destroy(FilterGraph *);
+
+#endif
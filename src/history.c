@@ -0,0 +1,273 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+#include "texture.h"
+#include "util.h"
+
+static void tile_rect(const History *, int, int *, int *, int *, int *);
+static uint64_t hash_tile(const History *, int, const unsigned char *, size_t);
+static void add_version(History *, int, uint32_t, uint64_t, const unsigned char *, size_t);
+static TileVersion *version_at(TileHistory *, uint32_t);
+static size_t show(History *, uint32_t, Texture *);
+static void drop_oldest(History *);
+
+static void
+tile_rect(const History *h, int i, int *x, int *y, int *w, int *rows)
+{
+    *x = (i % h->cols) * HISTORY_TILE_SIZE;
+    *y = (i / h->cols) * HISTORY_TILE_SIZE;
+    *w = MIN(HISTORY_TILE_SIZE, h->width - *x);
+    *rows = MIN(HISTORY_TILE_SIZE, h->height - *y);
+}
+
+/* Hash a tile of the image at `data` eight bytes at a time. Tiles with
+ * equal hashes are taken to be equal, 64 bits make a collision between two
+ * versions of the same tile unlikely enough.
+ */
+static uint64_t
+hash_tile(const History *h, int i, const unsigned char *data, size_t stride)
+{
+    int x, y, w, rows;
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+
+    tile_rect(h, i, &x, &y, &w, &rows);
+    size_t row_bytes = (size_t)w * h->bytes_per_pixel;
+
+    for (int r = 0; r < rows; r++) {
+        const unsigned char *p = data + (size_t)(y + r) * stride + (size_t)x * h->bytes_per_pixel;
+        size_t n = 0;
+
+        for (; n + 8 <= row_bytes; n += 8) {
+            uint64_t word;
+            memcpy(&word, p + n, 8);
+            hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 32;
+        }
+        for (; n < row_bytes; n++)
+            hash = (hash ^ p[n]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/* Store the tile as it is in the image at `data` */
+static void
+add_version(History *h, int i, uint32_t frame, uint64_t hash, const unsigned char *data, size_t stride)
+{
+    TileHistory *t = &h->tiles[i];
+    int x, y, w, rows;
+
+    tile_rect(h, i, &x, &y, &w, &rows);
+    size_t row_bytes = (size_t)w * h->bytes_per_pixel;
+
+    if (t->count == t->capacity) {
+        int capacity = t->capacity ? t->capacity * 2 : 2;
+        TileVersion *versions = realloc(t->versions, capacity * sizeof(TileVersion));
+        if (versions == NULL)
+            die("Malloc failed to allocate:");
+        t->versions = versions;
+        t->capacity = capacity;
+    }
+
+    unsigned char *pixels = malloc(row_bytes * rows);
+    if (pixels == NULL)
+        die("Malloc failed to allocate:");
+    for (int r = 0; r < rows; r++) {
+        memcpy(pixels + r * row_bytes,
+            data + (size_t)(y + r) * stride + (size_t)x * h->bytes_per_pixel, row_bytes);
+    }
+
+    t->versions[t->count++] = (TileVersion) { .frame = frame, .hash = hash, .pixels = pixels };
+    h->stored += row_bytes * rows;
+}
+
+/* The version of a tile shown in `frame` */
+static TileVersion *
+version_at(TileHistory *t, uint32_t frame)
+{
+    TileVersion *v = &t->versions[0];
+
+    for (int i = 1; i < t->count && t->versions[i].frame <= frame; i++)
+        v = &t->versions[i];
+    return v;
+}
+
+/* Start a history with `data` as its first frame, `width` x `height`
+ * pixels of `bytes_per_pixel` each, `stride` bytes apart.
+ */
+void
+history_init(History *h, const void *data, size_t stride, int width, int height,
+        int bytes_per_pixel, size_t limit)
+{
+    memset(h, 0, sizeof(*h));
+    h->width = width;
+    h->height = height;
+    h->bytes_per_pixel = bytes_per_pixel;
+    h->cols = (width + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    h->rows = (height + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    h->limit = limit;
+
+    h->tiles = calloc(h->cols * h->rows, sizeof(TileHistory));
+    if (h->tiles == NULL)
+        die("Malloc failed to allocate:");
+
+    for (int i = 0; i < h->cols * h->rows; i++)
+        add_version(h, i, 0, hash_tile(h, i, data, stride), data, stride);
+
+    h->count = 1;
+    h->changed = h->cols * h->rows;
+}
+
+bool
+history_active(const History *h)
+{
+    return h->tiles != NULL;
+}
+
+/* Replace the tiles of the texture that differ between the frame shown
+ * and `frame`. Neighbouring tiles of a row are gathered into one upload.
+ * Returns the number of bytes uploaded.
+ */
+static size_t
+show(History *h, uint32_t frame, Texture *tex)
+{
+    size_t stride = (size_t)h->width * h->bytes_per_pixel;
+    unsigned char *band = malloc(stride * HISTORY_TILE_SIZE);
+    size_t uploaded = 0;
+
+    if (band == NULL)
+        die("Malloc failed to allocate:");
+
+    for (int row = 0; row < h->rows; row++) {
+        for (int col = 0; col < h->cols; ) {
+            int start = col;
+            for (; col < h->cols; col++) {
+                TileHistory *t = &h->tiles[row * h->cols + col];
+                if (version_at(t, frame) == version_at(t, h->shown))
+                    break;
+            }
+            if (col == start) {
+                col++;
+                continue;
+            }
+
+            /* The run spans from its first tile to the end of its last */
+            int x0, y0, x1, y1, w, rows;
+            tile_rect(h, row * h->cols + start, &x0, &y0, &w, &rows);
+            tile_rect(h, row * h->cols + col - 1, &x1, &y1, &w, &rows);
+            x1 += w;
+
+            for (int i = start; i < col; i++) {
+                TileVersion *v = version_at(&h->tiles[row * h->cols + i], frame);
+                int x, y;
+
+                tile_rect(h, row * h->cols + i, &x, &y, &w, &rows);
+                size_t row_bytes = (size_t)w * h->bytes_per_pixel;
+                for (int r = 0; r < rows; r++) {
+                    memcpy(band + r * stride + (size_t)(x - x0) * h->bytes_per_pixel,
+                        v->pixels + r * row_bytes, row_bytes);
+                }
+            }
+            uploaded += texture_upload_region(tex, x0, y0, x1 - x0, rows, band, stride);
+        }
+    }
+
+    free(band);
+    h->shown = frame;
+    return uploaded;
+}
+
+/* Fold the oldest frame into the next one, freeing every tile version the
+ * next one replaced.
+ */
+static void
+drop_oldest(History *h)
+{
+    h->first++;
+    h->count--;
+
+    for (int i = 0; i < h->cols * h->rows; i++) {
+        TileHistory *t = &h->tiles[i];
+        int x, y, w, rows;
+
+        tile_rect(h, i, &x, &y, &w, &rows);
+        while (t->count > 1 && t->versions[1].frame <= h->first) {
+            free(t->versions[0].pixels);
+            h->stored -= (size_t)w * rows * h->bytes_per_pixel;
+            memmove(t->versions, t->versions + 1, (t->count - 1) * sizeof(TileVersion));
+            t->count--;
+        }
+    }
+}
+
+/* Add a capture in the same layout as the first one and show it. Only the
+ * tiles that changed since the latest frame are kept. Old frames are
+ * dropped while over the limit, the latest one always stays. Returns the
+ * number of bytes uploaded.
+ */
+size_t
+history_add(History *h, const void *data, size_t stride, Texture *tex)
+{
+    uint32_t frame = h->first + h->count;
+
+    h->changed = 0;
+    for (int i = 0; i < h->cols * h->rows; i++) {
+        TileHistory *t = &h->tiles[i];
+        uint64_t hash = hash_tile(h, i, data, stride);
+
+        if (hash == t->versions[t->count - 1].hash)
+            continue;
+        add_version(h, i, frame, hash, data, stride);
+        h->changed++;
+    }
+    h->count++;
+
+    size_t uploaded = show(h, frame, tex);
+    while (h->stored > h->limit && h->count > 1)
+        drop_oldest(h);
+    return uploaded;
+}
+
+/* Move `delta` frames away from the one shown, stopping at either end.
+ * Returns the number of bytes uploaded.
+ */
+size_t
+history_seek(History *h, int delta, Texture *tex)
+{
+    int64_t frame = (int64_t)h->shown + delta;
+    frame = CLAMP((int64_t)h->first, frame, (int64_t)(h->first + h->count - 1));
+
+    if ((uint32_t)frame == h->shown)
+        return 0;
+    return show(h, frame, tex);
+}
+
+/* Print the frame shown and how well the frames compress */
+void
+history_report(const History *h)
+{
+    size_t frame_bytes = (size_t)h->width * h->height * h->bytes_per_pixel;
+
+    fprintf(stderr, "History: frame %u of %u (%d tiles changed in the latest), "
+        "%.1f MiB stored for %.1f MiB of frames, %.1fx\n",
+        h->shown - h->first + 1, h->count, h->changed,
+        h->stored / (1024.0 * 1024.0),
+        (double)frame_bytes * h->count / (1024.0 * 1024.0),
+        h->stored ? (double)frame_bytes * h->count / h->stored : 0.0);
+}
+
+void
+history_destroy(History *h)
+{
+    for (int i = 0; h->tiles && i < h->cols * h->rows; i++) {
+        for (int j = 0; j < h->tiles[i].count; j++)
+            free(h->tiles[i].versions[j].pixels);
+        free(h->tiles[i].versions);
+    }
+    free(h->tiles);
+    memset(h, 0, sizeof(*h));
+}
@@ -0,0 +1,57 @@
+#ifndef ZOOC_HISTORY_H
+#define ZOOC_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "texture.h"
+
+#define HISTORY_TILE_SIZE   64
+
+/* The contents of a tile from `frame` on, until a later version replaces
+ * it.
+ */
+typedef struct {
+    uint32_t frame;
+    uint64_t hash;
+    unsigned char *pixels;
+} TileVersion;
+
+typedef struct {
+    TileVersion *versions;
+    int count;
+    int capacity;
+} TileHistory;
+
+/* Captures of the same area, in the pixel layout they were taken in. The
+ * first is stored whole, every later one only as the tiles whose hash
+ * changed. Frames are numbered from 0 as they are added; once the stored
+ * tiles take more than `limit` bytes the oldest frames are folded into the
+ * one after them.
+ */
+typedef struct {
+    int width;
+    int height;
+    int bytes_per_pixel;
+    int cols;
+    int rows;
+    TileHistory *tiles;
+
+    uint32_t first;
+    uint32_t count;
+    uint32_t shown;
+
+    size_t limit;
+    size_t stored;
+    int changed;
+} History;
+
+void history_init(History *, const void *, size_t, int, int, int, size_t);
+bool history_active(const History *);
+size_t history_add(History *, const void *, size_t, Texture *);
+size_t history_seek(History *, int, Texture *);
+void history_report(const History *);
+void history_destroy(History *);
+
+#endif
@@ -0,0 +1,299 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "util.h"
+
+/* Samples read for each axis of a pixel in the levels below the first, a
+ * cheap box filter that keeps zoomed out views from touching every page of
+ * the file.
+ */
+#define LEVEL_SAMPLES   2
+
+static void skip_space(const unsigned char *, size_t, size_t *);
+static bool read_number(const unsigned char *, size_t, size_t *, unsigned long *);
+static bool parse_pnm(Image *, size_t *);
+static bool parse_pam(Image *, size_t *);
+static bool parse_farbfeld(Image *, size_t *);
+static unsigned int sample(const Image *, const unsigned char *);
+
+/* Skip whitespace and comments between the fields of a header */
+static void
+skip_space(const unsigned char *p, size_t size, size_t *pos)
+{
+    while (*pos < size) {
+        if (p[*pos] == '#') {
+            while (*pos < size && p[*pos] != '\n')
+                (*pos)++;
+        } else if (isspace(p[*pos])) {
+            (*pos)++;
+        } else {
+            break;
+        }
+    }
+}
+
+static bool
+read_number(const unsigned char *p, size_t size, size_t *pos, unsigned long *value)
+{
+    skip_space(p, size, pos);
+    if (*pos >= size || !isdigit(p[*pos]))
+        return false;
+
+    *value = 0;
+    while (*pos < size && isdigit(p[*pos])) {
+        *value = *value * 10 + (p[*pos] - '0');
+        if (*value > UINT32_MAX)
+            return false;
+        (*pos)++;
+    }
+    return true;
+}
+
+/* Binary PGM (P5) and PPM (P6), with exactly one whitespace character
+ * between the maxval and the pixels.
+ */
+static bool
+parse_pnm(Image *img, size_t *offset)
+{
+    const unsigned char *p = img->map;
+    size_t pos = 2;
+    unsigned long width, height, maxval;
+
+    if (!read_number(p, img->map_size, &pos, &width)
+        || !read_number(p, img->map_size, &pos, &height)
+        || !read_number(p, img->map_size, &pos, &maxval)
+        || pos >= img->map_size || !isspace(p[pos]))
+        return false;
+
+    img->format = p[1] == '5' ? "PGM" : "PPM";
+    img->width = width;
+    img->height = height;
+    img->channels = p[1] == '5' ? 1 : 3;
+    img->maxval = maxval;
+    *offset = pos + 1;
+    return true;
+}
+
+/* PAM (P7) headers are lines of a keyword and its value up to ENDHDR. The
+ * tuple type only names what DEPTH already tells us.
+ */
+static bool
+parse_pam(Image *img, size_t *offset)
+{
+    const unsigned char *p = img->map;
+    size_t pos = 2;
+    unsigned long width = 0, height = 0, depth = 0, maxval = 0;
+
+    for (;;) {
+        skip_space(p, img->map_size, &pos);
+
+        size_t start = pos;
+        while (pos < img->map_size && isupper(p[pos]))
+            pos++;
+
+        const char *key = (const char *)p + start;
+        size_t len = pos - start;
+        bool ok = true;
+
+        if (len == 6 && !memcmp(key, "ENDHDR", len)) {
+            while (pos < img->map_size && p[pos] != '\n')
+                pos++;
+            pos++;
+            break;
+        } else if (len == 5 && !memcmp(key, "WIDTH", len)) {
+            ok = read_number(p, img->map_size, &pos, &width);
+        } else if (len == 6 && !memcmp(key, "HEIGHT", len)) {
+            ok = read_number(p, img->map_size, &pos, &height);
+        } else if (len == 5 && !memcmp(key, "DEPTH", len)) {
+            ok = read_number(p, img->map_size, &pos, &depth);
+        } else if (len == 6 && !memcmp(key, "MAXVAL", len)) {
+            ok = read_number(p, img->map_size, &pos, &maxval);
+        } else if (len == 8 && !memcmp(key, "TUPLTYPE", len)) {
+            while (pos < img->map_size && p[pos] != '\n')
+                pos++;
+        } else {
+            ok = false;
+        }
+        if (!ok)
+            return false;
+    }
+
+    if (depth < 1 || depth > 4)
+        return false;
+
+    img->format = "PAM";
+    img->width = width;
+    img->height = height;
+    img->channels = depth;
+    img->maxval = maxval;
+    *offset = pos;
+    return true;
+}
+
+/* farbfeld is its magic, the size as two big endian 32 bit numbers and
+ * 16 bit RGBA pixels.
+ */
+static bool
+parse_farbfeld(Image *img, size_t *offset)
+{
+    const unsigned char *p = img->map;
+
+    if (img->map_size < 16)
+        return false;
+
+    uint32_t width  = (uint32_t)p[8]  << 24 | p[9]  << 16 | p[10] << 8 | p[11];
+    uint32_t height = (uint32_t)p[12] << 24 | p[13] << 16 | p[14] << 8 | p[15];
+    if (width > INT32_MAX || height > INT32_MAX)
+        return false;
+
+    img->format = "farbfeld";
+    img->width = width;
+    img->height = height;
+    img->channels = 4;
+    img->maxval = 65535;
+    *offset = 16;
+    return true;
+}
+
+/* Map the image at `path`, printing why when it can't be shown */
+bool
+image_open(Image *img, const char *path)
+{
+    struct stat st;
+    size_t offset = 0;
+    bool ok = false;
+
+    memset(img, 0, sizeof(*img));
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+    if (st.st_size < 3) {
+        fprintf(stderr, "%s: not a PPM, PAM or farbfeld image\n", path);
+        close(fd);
+        return false;
+    }
+
+    /* The mapping outlives the descriptor */
+    img->map_size = st.st_size;
+    img->map = mmap(NULL, img->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (img->map == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        img->map = NULL;
+        return false;
+    }
+
+    const unsigned char *p = img->map;
+    if (p[0] == 'P' && (p[1] == '5' || p[1] == '6'))
+        ok = parse_pnm(img, &offset);
+    else if (p[0] == 'P' && p[1] == '7')
+        ok = parse_pam(img, &offset);
+    else if (img->map_size >= 8 && !memcmp(p, "farbfeld", 8))
+        ok = parse_farbfeld(img, &offset);
+
+    if (!ok || img->width < 1 || img->height < 1
+        || img->maxval < 1 || img->maxval > 65535) {
+        fprintf(stderr, "%s: not a PPM, PAM or farbfeld image\n", path);
+        image_close(img);
+        return false;
+    }
+
+    img->sample_bytes = img->maxval > 255 ? 2 : 1;
+    img->stride = (size_t)img->width * img->channels * img->sample_bytes;
+    if (offset > img->map_size
+        || img->stride / img->channels / img->sample_bytes != (size_t)img->width
+        || (img->map_size - offset) / img->stride < (size_t)img->height) {
+        fprintf(stderr, "%s: %dx%d %s image is truncated\n",
+            path, img->width, img->height, img->format);
+        image_close(img);
+        return false;
+    }
+    img->pixels = p + offset;
+    return true;
+}
+
+/* A sample scaled to eight bits */
+static unsigned int
+sample(const Image *img, const unsigned char *p)
+{
+    unsigned int v = img->sample_bytes == 2 ? (unsigned int)p[0] << 8 | p[1] : p[0];
+
+    if (img->maxval == 255)
+        return v;
+    return (v * 255 + img->maxval / 2) / img->maxval;
+}
+
+/* Convert a `width` x `height` rectangle at (x, y) of mip level `level` to
+ * BGRA rows, `stride` bytes apart. A pixel of level n covers 2^n x 2^n
+ * pixels of the image and averages LEVEL_SAMPLES x LEVEL_SAMPLES of them.
+ * Alpha is composited over black.
+ */
+void
+image_read(const Image *img, int level, int x, int y, int width, int height,
+        unsigned char *dst, size_t stride)
+{
+    long step = 1L << level;
+    int n = MIN(step, LEVEL_SAMPLES);
+    size_t pixel_bytes = (size_t)img->channels * img->sample_bytes;
+
+    for (int j = 0; j < height; j++) {
+        unsigned char *out = dst + (size_t)j * stride;
+
+        for (int i = 0; i < width; i++) {
+            unsigned int sum[4] = {0};
+
+            for (int sy = 0; sy < n; sy++) {
+                long py = MIN(((long)(y + j) << level) + (2 * sy + 1) * step / (2 * n),
+                    (long)img->height - 1);
+                const unsigned char *row = img->pixels + (size_t)py * img->stride;
+
+                for (int sx = 0; sx < n; sx++) {
+                    long px = MIN(((long)(x + i) << level) + (2 * sx + 1) * step / (2 * n),
+                        (long)img->width - 1);
+                    const unsigned char *s = row + (size_t)px * pixel_bytes;
+                    unsigned int v[4] = {0, 0, 0, 255};
+
+                    for (int c = 0; c < img->channels; c++)
+                        v[c] = sample(img, s + c * img->sample_bytes);
+
+                    /* Gray and gray with alpha spread over red, green and blue */
+                    if (img->channels < 3) {
+                        v[3] = img->channels == 2 ? v[1] : 255;
+                        v[1] = v[2] = v[0];
+                    }
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += v[c] * v[3] / 255;
+                }
+            }
+
+            out[0] = sum[2] / (n * n);
+            out[1] = sum[1] / (n * n);
+            out[2] = sum[0] / (n * n);
+            out[3] = 255;
+            out += 4;
+        }
+    }
+}
+
+void
+image_close(Image *img)
+{
+    if (img->map != NULL)
+        munmap(img->map, img->map_size);
+    memset(img, 0, sizeof(*img));
+}
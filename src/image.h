@@ -0,0 +1,29 @@
+#ifndef ZOOC_IMAGE_H
+#define ZOOC_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* An image file mapped into memory as it is on disk. Samples are one byte,
+ * or two big endian bytes when `maxval` is above 255. Nothing is read until
+ * image_read asks for it, so opening a file of any size is instant.
+ */
+typedef struct {
+    void *map;
+    size_t map_size;
+    const char *format;
+
+    const unsigned char *pixels;
+    int width;
+    int height;
+    int channels;
+    int sample_bytes;
+    unsigned int maxval;
+    size_t stride;
+} Image;
+
+bool image_open(Image *, const char *);
+void image_read(const Image *, int, int, int, int, int, unsigned char *, size_t);
+void image_close(Image *);
+
+#endif
@@ -0,0 +1,394 @@
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+#include "input.h"
+#include "ring.h"
+#include "util.h"
+
+static void query_scrollers(Display *, Input *);
+static Scroller *find_scroller(Input *, int, int);
+static bool select_xi2(Input *, Window);
+static void scroll_valuators(Input *, XIDeviceEvent *);
+static bool translate_device_event(Input *, XIDeviceEvent *, XEvent *);
+static bool translate(Input *, XEvent *);
+static void reset_scrollers(Input *);
+static void take_focus(Input *);
+static void release_focus(Input *);
+static void post(Input *, uint64_t, XEvent *);
+static void *event_thread(void *);
+
+/* Remember the vertical scroll valuators of every device, events name the
+ * physical device they came from in their sourceid.
+ */
+static void
+query_scrollers(Display *dpy, Input *in)
+{
+    int count = 0;
+    XIDeviceInfo *devices = XIQueryDevice(dpy, XIAllDevices, &count);
+
+    free(in->scrollers);
+    in->scrollers = NULL;
+    in->scroller_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < devices[i].num_classes; j++) {
+            XIScrollClassInfo *info = (XIScrollClassInfo *)devices[i].classes[j];
+            if (info->type != XIScrollClass
+                || info->scroll_type != XIScrollTypeVertical
+                || info->increment == 0.0)
+                continue;
+
+            Scroller *s = realloc(in->scrollers, (in->scroller_count + 1) * sizeof(Scroller));
+            if (s == NULL)
+                die("Malloc failed to allocate:");
+
+            in->scrollers = s;
+            in->scrollers[in->scroller_count++] = (Scroller) {
+                .deviceid = devices[i].deviceid,
+                .number = info->number,
+                .increment = info->increment,
+            };
+        }
+    }
+
+    if (devices)
+        XIFreeDeviceInfo(devices);
+}
+
+static Scroller *
+find_scroller(Input *in, int deviceid, int number)
+{
+    for (int i = 0; i < in->scroller_count; i++) {
+        if (in->scrollers[i].deviceid == deviceid && in->scrollers[i].number == number)
+            return &in->scrollers[i];
+    }
+    return NULL;
+}
+
+/* Listen for XInput2 (>= 2.1 for smooth scrolling) pointer events on `w`.
+ * Selecting them replaces the core pointer events, keys stay core events.
+ * Returns false when the extension is missing and core events are used.
+ */
+static bool
+select_xi2(Input *in, Window w)
+{
+    Display *dpy = in->dpy;
+    int event, error, major = 2, minor = 1;
+
+    if (!XQueryExtension(dpy, "XInputExtension", &in->opcode, &event, &error)
+        || XIQueryVersion(dpy, &major, &minor) != Success
+        || major < 2)
+        return false;
+
+    unsigned char bits[XIMaskLen(XI_Motion)] = {0};
+    XISetMask(bits, XI_DeviceChanged);
+    XISetMask(bits, XI_ButtonPress);
+    XISetMask(bits, XI_ButtonRelease);
+    XISetMask(bits, XI_Motion);
+
+    XIEventMask mask = {
+        .deviceid = XIAllMasterDevices,
+        .mask_len = sizeof(bits),
+        .mask = bits,
+    };
+    XISelectEvents(dpy, w, &mask, 1);
+
+    query_scrollers(dpy, in);
+    in->xi2 = true;
+    return true;
+}
+
+/* Turn the change of each scroll valuator into fractional wheel clicks. The
+ * first value seen only sets the baseline, valuators are absolute.
+ */
+static void
+scroll_valuators(Input *in, XIDeviceEvent *ev)
+{
+    double *value = ev->valuators.values;
+
+    for (int i = 0; i < ev->valuators.mask_len * 8; i++) {
+        if (!XIMaskIsSet(ev->valuators.mask, i))
+            continue;
+
+        double v = *value++;
+        Scroller *s = find_scroller(in, ev->sourceid, i);
+        if (s == NULL)
+            continue;
+
+        /* Positive increments scroll down, away from the user */
+        if (s->has_last) {
+            in->scroll -= (v - s->last) / s->increment;
+            in->scroll_state = ev->mods.effective;
+        }
+        s->last = v;
+        s->has_last = true;
+    }
+}
+
+static bool
+translate_device_event(Input *in, XIDeviceEvent *ev, XEvent *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    switch (ev->evtype) {
+    case XI_Motion:
+        scroll_valuators(in, ev);
+
+        out->xmotion = (XMotionEvent) {
+            .type = MotionNotify,
+            .display = ev->display,
+            .window = ev->event,
+            .root = ev->root,
+            .time = ev->time,
+            .x = ev->event_x,
+            .y = ev->event_y,
+            .x_root = ev->root_x,
+            .y_root = ev->root_y,
+            .state = ev->mods.effective,
+        };
+        return true;
+    case XI_ButtonPress:
+    case XI_ButtonRelease:
+        /* Wheel clicks emulated from smooth scrolling were already counted
+         * through the valuators.
+         */
+        if ((ev->flags & XIPointerEmulated) && BETWEEN(ev->detail, 4, 7))
+            return false;
+
+        out->xbutton = (XButtonEvent) {
+            .type = ev->evtype == XI_ButtonPress ? ButtonPress : ButtonRelease,
+            .display = ev->display,
+            .window = ev->event,
+            .root = ev->root,
+            .time = ev->time,
+            .x = ev->event_x,
+            .y = ev->event_y,
+            .x_root = ev->root_x,
+            .y_root = ev->root_y,
+            .state = ev->mods.effective,
+            .button = ev->detail,
+        };
+        return true;
+    }
+    return false;
+}
+
+/* Prepare an event for the core handlers. XInput2 events are rewritten in
+ * place as core events, returns false when there is nothing left to
+ * handle.
+ */
+static bool
+translate(Input *in, XEvent *e)
+{
+    if (e->type != GenericEvent)
+        return true;
+
+    if (!in->xi2 || e->xcookie.extension != in->opcode || !XGetEventData(in->dpy, &e->xcookie))
+        return false;
+
+    XEvent core;
+    bool handle = false;
+
+    if (e->xcookie.evtype == XI_DeviceChanged) {
+        /* Another physical device now drives the pointer */
+        query_scrollers(in->dpy, in);
+    } else {
+        handle = translate_device_event(in, e->xcookie.data, &core);
+    }
+
+    XFreeEventData(in->dpy, &e->xcookie);
+    if (handle)
+        *e = core;
+    return handle;
+}
+
+/* Forget the valuator baselines, they moved while the pointer was away */
+static void
+reset_scrollers(Input *in)
+{
+    for (int i = 0; i < in->scroller_count; i++)
+        in->scrollers[i].has_last = false;
+}
+
+/* Focus is taken whenever the window is mapped and held with a keyboard
+ * grab. The window has to be viewable for the grab to succeed, so keep
+ * trying for a moment after it was mapped.
+ */
+static void
+take_focus(Input *in)
+{
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+    int revert_to;
+
+    if (!in->grab || in->grabbed)
+        return;
+
+    XGetInputFocus(in->dpy, &in->focus, &revert_to);
+    for (int i = 0; i < 1000; i++) {
+        if (XGrabKeyboard(in->dpy, in->window, True, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess) {
+            in->grabbed = true;
+            break;
+        }
+        nanosleep(&ts, NULL);
+    }
+    if (!in->grabbed)
+        fprintf(stderr, "Unable to grab the keyboard\n");
+
+    XSetInputFocus(in->dpy, in->window, RevertToParent, CurrentTime);
+    XFlush(in->dpy);
+}
+
+/* Give the focus back to whoever had it before the window was mapped */
+static void
+release_focus(Input *in)
+{
+    if (!in->grab || in->focus == None)
+        return;
+
+    if (in->grabbed)
+        XUngrabKeyboard(in->dpy, CurrentTime);
+    XSetInputFocus(in->dpy, in->focus, RevertToParent, CurrentTime);
+    XFlush(in->dpy);
+
+    in->grabbed = false;
+    in->focus = None;
+}
+
+/* Hand a record to the renderer. Should it fall a whole ring behind, the
+ * input is lost rather than stalling the X connection.
+ */
+static void
+post(Input *in, uint64_t time, XEvent *e)
+{
+    InputRecord record = { .time = time };
+
+    if (e != NULL) {
+        record.event = *e;
+    } else {
+        record.event.type = INPUT_SCROLL;
+        record.clicks = in->scroll;
+        record.state = in->scroll_state;
+        in->scroll = 0.0f;
+    }
+    ring_push(in->ring, &record);
+}
+
+static void *
+event_thread(void *arg)
+{
+    Input *in = arg;
+    struct pollfd fds[2] = {
+        { .fd = ConnectionNumber(in->dpy), .events = POLLIN },
+        { .fd = in->quit[0], .events = POLLIN },
+    };
+
+    for (;;) {
+        while (XPending(in->dpy) > 0) {
+            XEvent e;
+            XNextEvent(in->dpy, &e);
+            uint64_t time = now_ns();
+
+            if (!translate(in, &e)) {
+                if (in->scroll != 0.0f)
+                    post(in, time, NULL);
+                continue;
+            }
+
+            switch (e.type) {
+            case MapNotify:
+                take_focus(in);
+                break;
+            case UnmapNotify:
+                release_focus(in);
+                break;
+            case LeaveNotify:
+                reset_scrollers(in);
+                /* fallthrough */
+            case KeyPress:
+            case ButtonPress:
+            case ButtonRelease:
+            case MotionNotify:
+                if (in->scroll != 0.0f)
+                    post(in, time, NULL);
+                post(in, time, &e);
+                break;
+            }
+        }
+
+        poll(fds, LENGTH(fds), -1);
+        if (fds[1].revents)
+            return NULL;
+    }
+}
+
+/* Connect to the display a second time for input only and select the
+ * pointer and key events of `w` there, the rendering connection never sees
+ * them. With `grab` the keyboard is grabbed each time `w` is mapped.
+ */
+void
+input_open(Input *in, const char *display_name, Window w, bool grab)
+{
+    memset(in, 0, sizeof(*in));
+    in->window = w;
+    in->grab = grab;
+
+    in->dpy = XOpenDisplay(display_name);
+    if (in->dpy == NULL)
+        die("Cannot open a second connection to the X display server for input\n");
+
+    XSelectInput(in->dpy, w, ButtonPressMask | ButtonReleaseMask
+        | KeyPressMask | KeyReleaseMask | PointerMotionMask | LeaveWindowMask
+        | StructureNotifyMask);
+
+    /* Smooth scrolling comes through XInput2, which replaces the core
+     * pointer events selected above when it is available.
+     */
+    select_xi2(in, w);
+
+    /* Everything has to be selected before the window is first mapped */
+    XSync(in->dpy, False);
+
+    if (pipe(in->quit) < 0)
+        die("Unable to create the input pipe:");
+}
+
+/* From here on only the input thread touches the input connection */
+void
+input_start(Input *in, InputRing *ring)
+{
+    in->ring = ring;
+    if (pthread_create(&in->thread, NULL, event_thread, in) != 0)
+        die("Unable to start the input thread\n");
+    in->started = true;
+}
+
+/* Stop the input thread, give the focus back and close its connection */
+void
+input_destroy(Input *in)
+{
+    if (in->dpy == NULL)
+        return;
+
+    if (in->started) {
+        char byte = 0;
+        ssize_t n = write(in->quit[1], &byte, 1);
+        UNUSED(n);
+        pthread_join(in->thread, NULL);
+    }
+    close(in->quit[0]);
+    close(in->quit[1]);
+
+    release_focus(in);
+    free(in->scrollers);
+    XCloseDisplay(in->dpy);
+    memset(in, 0, sizeof(*in));
+}
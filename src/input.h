@@ -0,0 +1,52 @@
+#ifndef ZOOC_INPUT_H
+#define ZOOC_INPUT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+
+#include "ring.h"
+
+/* A smooth scrolling valuator of a physical device */
+typedef struct {
+    int deviceid;
+    int number;
+    double increment;
+    double last;
+    bool has_last;
+} Scroller;
+
+/* Keyboard and pointer input, read on a thread with its own connection to
+ * the X server and posted to an InputRing. XInput2 device events are turned
+ * back into their core counterparts, except for smooth scrolling which is
+ * posted as wheel clicks towards the user.
+ */
+typedef struct {
+    Display *dpy;
+    pthread_t thread;
+    bool started;
+    int quit[2];
+    InputRing *ring;
+
+    /* Keyboard focus is taken while the window is mapped */
+    Window window;
+    bool grab;
+    bool grabbed;
+    Window focus;
+
+    bool xi2;
+    int opcode;
+
+    Scroller *scrollers;
+    int scroller_count;
+
+    float scroll;
+    unsigned int scroll_state;
+} Input;
+
+void input_open(Input *, const char *, Window, bool);
+void input_start(Input *, InputRing *);
+void input_destroy(Input *);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "capture.h"
+#include "live.h"
+#include "stats.h"
+#include "texture.h"
+#include "tfp.h"
+#include "util.h"
+
+/* Past this many rectangles a single bounding box is cheaper to fetch than
+ * the per-request overhead of every piece.
+ */
+#define LIVE_MAX_RECTS      32
+#define BYTES_PER_PIXEL     4
+
+static void exclude_window(Display *, Live *, XserverRegion);
+static unsigned int upload_band(Display *, Live *, Texture *, XRectangle);
+
+bool
+live_init(Display *dpy, Live *live, Window root, Window exclude,
+        XRectangle area, size_t budget)
+{
+    int error_base, major, minor;
+
+    memset(live, 0, sizeof(*live));
+
+    if (!XDamageQueryExtension(dpy, &live->event_base, &error_base)
+        || !XDamageQueryVersion(dpy, &major, &minor))
+        return false;
+
+    if (!XFixesQueryExtension(dpy, &major, &error_base)
+        || !XFixesQueryVersion(dpy, &major, &minor) || major < 2)
+        return false;
+
+    live->root    = root;
+    live->exclude = exclude;
+    live->area    = area;
+    live->budget  = MAX(budget, BYTES_PER_PIXEL);
+    live->damage  = XDamageCreate(dpy, root, XDamageReportNonEmpty);
+    live->pending = XFixesCreateRegion(dpy, NULL, 0);
+    return true;
+}
+
+bool
+live_is_damage_event(Live *live, XEvent *e)
+{
+    if (live->damage == None || e->type != live->event_base + XDamageNotify)
+        return false;
+
+    live->dirty = true;
+    return true;
+}
+
+/* Our own window shows up in the root's damage every time we swap, but what
+ * it covers can never be captured anyway. Drop it so zooc doesn't chase its
+ * own frames.
+ */
+static void
+exclude_window(Display *dpy, Live *live, XserverRegion scratch)
+{
+    XWindowAttributes attrs;
+    Window child;
+    int x, y;
+
+    if (live->exclude == None
+        || !XGetWindowAttributes(dpy, live->exclude, &attrs)
+        || attrs.map_state != IsViewable)
+        return;
+
+    XTranslateCoordinates(dpy, live->exclude, live->root, 0, 0, &x, &y, &child);
+
+    XRectangle r = { x, y, attrs.width, attrs.height };
+    XFixesSetRegion(dpy, scratch, &r, 1);
+    XFixesSubtractRegion(dpy, live->pending, live->pending, scratch);
+}
+
+/* Capture a band of the watched area into the scratch image and upload it
+ * to the texture, in as many pieces as the scratch segment requires. The
+ * band is in texture coordinates. Returns how many of its rows, from the
+ * top, made it into the texture.
+ */
+static unsigned int
+upload_band(Display *dpy, Live *live, Texture *tex, XRectangle r)
+{
+    if (live->scratch.image == NULL) {
+        unsigned int width = live->area.width;
+        unsigned int rows = MAX(1, live->budget / ((size_t)width * BYTES_PER_PIXEL));
+
+        capture_open(dpy, &live->scratch, live->root,
+            live->area.x, live->area.y, width, MIN(rows, live->area.height));
+    }
+
+    unsigned int chunk = r.height;
+    if (live->scratch.capacity)
+        chunk = MAX(1, live->scratch.capacity / ((size_t)r.width * BYTES_PER_PIXEL));
+
+    for (unsigned int row = 0; row < r.height; row += chunk) {
+        unsigned int rows = MIN(chunk, r.height - row);
+        if (!capture_region(dpy, &live->scratch,
+                live->area.x + r.x, live->area.y + r.y + row, r.width, rows))
+            return row;
+
+        XImage *img = live->scratch.image;
+        texture_upload_region(tex, r.x, r.y + row, r.width, rows,
+            img->data, img->bytes_per_line);
+    }
+    return r.height;
+}
+
+/* Bring the texture up to date with the damage accumulated since the
+ * last frame. At most `budget` bytes are uploaded per call; whatever does not
+ * fit stays pending for the next frame. Returns the number of bytes updated.
+ */
+size_t
+live_update(Display *dpy, Live *live, Texture *tex, PixmapTexture *pt)
+{
+    XRectangle bounds;
+    XRectangle done[LIVE_MAX_RECTS];
+    int count = 0, ndone = 0;
+    size_t used = 0;
+
+    if (!live->dirty)
+        return 0;
+
+    XserverRegion region = XFixesCreateRegion(dpy, NULL, 0);
+    XDamageSubtract(dpy, live->damage, None, region);
+    XFixesUnionRegion(dpy, live->pending, live->pending, region);
+    exclude_window(dpy, live, region);
+
+    XFixesSetRegion(dpy, region, &live->area, 1);
+    XFixesIntersectRegion(dpy, live->pending, live->pending, region);
+
+    XRectangle *rects = XFixesFetchRegionAndBounds(dpy, live->pending, &count, &bounds);
+    if (count > LIVE_MAX_RECTS) {
+        rects[0] = bounds;
+        count = 1;
+    }
+
+    live->dirty = false;
+    for (int i = 0; i < count; i++) {
+        XRectangle r = rects[i];
+        r.x -= live->area.x;
+        r.y -= live->area.y;
+        size_t row_bytes = (size_t)r.width * BYTES_PER_PIXEL;
+        size_t rows = (live->budget - used) / row_bytes;
+
+        /* Always make progress, even on a rectangle wider than the budget */
+        if (rows == 0 && used == 0)
+            rows = 1;
+        if (rows < r.height)
+            live->dirty = true;
+        if (rows == 0)
+            break;
+
+        r.height = MIN(r.height, rows);
+        done[ndone++] = r;
+        used += row_bytes * r.height;
+    }
+
+    if (pt != NULL) {
+        tfp_update(dpy, pt, done, ndone);
+        stats.upload_bytes += used;
+    } else {
+        /* What failed to capture stays pending and is tried again */
+        for (int i = 0; i < ndone; i++) {
+            unsigned int rows = upload_band(dpy, live, tex, done[i]);
+            if (rows < done[i].height) {
+                used -= (size_t)done[i].width * (done[i].height - rows) * BYTES_PER_PIXEL;
+                done[i].height = rows;
+                live->dirty = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < ndone; i++) {
+        done[i].x += live->area.x;
+        done[i].y += live->area.y;
+    }
+    XFixesSetRegion(dpy, region, done, ndone);
+    XFixesSubtractRegion(dpy, live->pending, live->pending, region);
+    XFixesDestroyRegion(dpy, region);
+    XFree(rects);
+
+    return used;
+}
+
+void
+live_destroy(Display *dpy, Live *live)
+{
+    if (live->damage != None)
+        XDamageDestroy(dpy, live->damage);
+    if (live->pending != None)
+        XFixesDestroyRegion(dpy, live->pending);
+    capture_destroy(dpy, &live->scratch);
+
+    memset(live, 0, sizeof(*live));
+}
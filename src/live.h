@@ -0,0 +1,38 @@
+#ifndef ZOOC_LIVE_H
+#define ZOOC_LIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+#include <GL/gl.h>
+
+#include "capture.h"
+#include "texture.h"
+#include "tfp.h"
+
+/* Keeps the screenshot texture current by re-capturing only the parts of
+ * the root window that XDamage reports as changed.
+ */
+typedef struct {
+    Window root;
+    Window exclude;
+    XRectangle area;
+    Damage damage;
+    XserverRegion pending;
+    int event_base;
+    bool dirty;
+
+    size_t budget;
+    Capture scratch;
+} Live;
+
+bool live_init(Display *, Live *, Window, Window, XRectangle, size_t);
+bool live_is_damage_event(Live *, XEvent *);
+size_t live_update(Display *, Live *, Texture *, PixmapTexture *);
+void live_destroy(Display *, Live *);
+
+#endif
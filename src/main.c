@@ -1,11 +1,14 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
+#include <math.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <X11/X.h>
-#include <X11/extensions/Xrandr.h>
 #include <X11/XKBlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
@@ -16,127 +19,754 @@
 #include <GL/gl.h>
 #include <GL/glx.h>
 
+#include "capture.h"
 #include "config.h"
+#include "convert.h"
+#include "daemon.h"
+#include "export.h"
+#include "filter.h"
+#include "history.h"
+#include "image.h"
+#include "input.h"
+#include "live.h"
+#include "memory.h"
+#include "monitor.h"
 #include "navigation.h"
+#include "present.h"
+#include "render.h"
+#include "ring.h"
+#include "sampling.h"
+#include "shader.h"
+#include "stats.h"
+#include "stream.h"
+#include "texture.h"
+#include "tfp.h"
+#include "timing.h"
 #include "util.h"
 #include "vec.h"
+#include "viewer.h"
+#include "watch.h"
 
 #define MIN_GLX_MAJOR   1
 #define MIN_GLX_MINOR   3
 
-GLuint load_shader(const char *, GLenum);
-XImage* get_screenshot();
 void button_press(XEvent *);
 void button_release(XEvent *);
+void capture_history(void);
 void check_glx_version(Display *);
-void destroy_screenshot(XImage*);
-void draw_image(Camera *, XImage *, GLuint, GLuint, Vec2f, Mouse *, Flashlight *);
+void apply_motion(void);
+XRectangle choose_area(void);
+void close_screenshot(void);
+void drop_capture(void);
+void draw_frame(void);
+void draw_screenshot(Camera *, GLuint, Texture *, Vec2f, Vec2f, Vec2f);
+void filter_screenshot(void);
+float fit_image(void);
+void dispatch_input(InputRecord *);
 void keypress(XEvent *);
+void leave_notify(XEvent *);
+XRectangle monitor_area(int);
 void motion_notify(XEvent *);
+void open_image(XRectangle);
+void open_screenshot(XRectangle, Drawable, int, int);
+void open_stream(XRectangle, const char *);
+bool reload(void);
+void release_capture(void);
+size_t screenshot_bytes(void);
+void reload_config(void);
+void reload_filters(void);
+void reload_shaders(void);
+void reset_view(void);
+void run(void);
+void set_sampling(void);
+void scrub(int);
+void start_history(void);
+void snapshot(void);
 void scroll_down(unsigned int, bool);
 void scroll_up(unsigned int, bool);
+void zoom(float, bool);
+void serve(int, bool);
+void refuse_activations(void);
+void switch_monitor(int);
+void wait_for_events(float);
 
 static Display *dpy = NULL;
 static int screen = 0;
 static XWindowAttributes wa;
 static Window w;
+static Atom wm_delete_atom;
 static bool running = true;
 
+/* Client of a resident zooc waiting for the first frame, and the socket
+ * further activations arrive on while a session is shown, see serve
+ */
+static int activation = -1;
+static int listening = -1;
+
 static Flashlight flashlight;
 static Camera camera;
 static Mouse mouse;
 static Config config;
+static Shaders shaders;
+static ShaderBuild shader_build;
+static Watch watch = { .fd = -1 };
+static RenderState render;
+static FilterGraph filters;
+static Export export;
+static Present present;
+static Input input;
+static InputRing ring;
+
+static Capture capture;
+static Display *capture_dpy = NULL;
+static PixmapTexture pixmap_texture;
+static GLuint pixmap_filtered;
+static unsigned int pixmap_generation;
+static Texture texture;
+static Live live;
+static History history;
+static XRectangle screenshot_area;
+static bool zero_copy = false;
+static bool live_enabled = false;
+static bool report_memory = false;
+static GLuint quad_vao, quad_vbo, quad_ebo;
+static Vec2f screenshot_size;
+static Vec2f window_size;
+
+/* An image file shown instead of a screenshot */
+static Image image;
+static Viewer viewer;
+static bool viewing = false;
+
+/* Raw frames read from a pipe, uploaded through the screenshot texture */
+static Stream stream;
+static bool streaming = false;
+static uint64_t stream_time;
+
+/* Pointer position of the latest motion event not yet applied */
+static Vec2f pointer;
+static bool pointer_moved = false;
+
+/* Smooth scrolling received since the last frame, in wheel clicks */
+static float scroll = 0.0f;
+static unsigned int scroll_state = 0;
+
+static Monitor *monitors = NULL;
+static int monitor_count = 0;
+static int current_monitor = MONITOR_ALL;
+static float frame_time;
 
 static void (*handler[LASTEvent]) (XEvent *) = {
     [MotionNotify] = motion_notify,
     [KeyPress] = keypress,
     [ButtonPress] = button_press,
     [ButtonRelease] = button_release,
+    [LeaveNotify] = leave_notify,
 };
 
-GLuint
-load_shader(const char *name, GLenum type)
+void
+check_glx_version(Display *dpy)
+{
+    int glx_major, glx_minor;
+    // Check shit if necessary
+    if (!glXQueryVersion(dpy, &glx_major, &glx_minor)
+        || (glx_minor == MIN_GLX_MAJOR && glx_minor < MIN_GLX_MINOR)
+        || (MIN_GLX_MAJOR < 1))
+        die("Invalid GLX version %d.%d. Requires GLX >= %d.%d", glx_major, glx_minor, MIN_GLX_MAJOR, MIN_GLX_MINOR);
+}
+
+/* Draw the frame with the cheapest shader variants that give the same
+ * picture. Without the flashlight the screenshot is drawn as is. With it,
+ * everything is dimmed in a cheap pass and only the box around the circle
+ * is drawn again with its anti-aliased edge.
+ */
+void
+draw_frame(void)
 {
-    FILE *fp = fopen(name, "r");
-    GLchar *shaderSrc = NULL;
+    render_clear(&render);
+    if (flashlight.shadow <= 0.0f) {
+        render_use(&render, SHADER_PLAIN, &camera, &mouse, &flashlight, screenshot_size, window_size);
+        draw_screenshot(&camera, quad_vao, &texture, window_size, ZERO, window_size);
+        return;
+    }
 
-    if (fp == NULL)
-        die("Unable to open shader file at '%s':", name);
+    /* The edge is a pixel wide, leave some room for it */
+    float radius = flashlight.radius * camera.scale + 2.0f;
+    Vec2f from = SUBS(mouse.current, radius);
+    Vec2f to = ADDS(mouse.current, radius);
+    from = (Vec2f) {MAX(from.x, 0.0f), MAX(from.y, 0.0f)};
+    to = (Vec2f) {MIN(to.x, window_size.x), MIN(to.y, window_size.y)};
+
+    if (EQ(from, ZERO) && EQ(to, window_size)) {
+        render_use(&render, SHADER_FLASHLIGHT, &camera, &mouse, &flashlight, screenshot_size, window_size);
+        draw_screenshot(&camera, quad_vao, &texture, window_size, ZERO, window_size);
+        return;
+    }
+
+    render_use(&render, SHADER_DIM, &camera, &mouse, &flashlight, screenshot_size, window_size);
+    draw_screenshot(&camera, quad_vao, &texture, window_size, ZERO, window_size);
+    if (from.x >= to.x || from.y >= to.y)
+        return;
+
+    /* Scissor boxes count from the bottom of the window */
+    GL(glEnable(GL_SCISSOR_TEST));
+    GL(glScissor(floorf(from.x), floorf(window_size.y - to.y),
+        ceilf(to.x) - floorf(from.x), ceilf(to.y) - floorf(from.y)));
+    render_use(&render, SHADER_FLASHLIGHT, &camera, &mouse, &flashlight, screenshot_size, window_size);
+    draw_screenshot(&camera, quad_vao, &texture, window_size, from, to);
+    GL(glDisable(GL_SCISSOR_TEST));
+}
+
+/* Draw the part of the screenshot that shows between `from` and `to`, in
+ * window coordinates. Zero copy screenshots are a single quad, uploaded ones
+ * and image files are drawn tile by tile.
+ */
+void
+draw_screenshot(Camera *cam, GLuint vao, Texture *tex, Vec2f window_size, Vec2f from, Vec2f to)
+{
+    if (viewing) {
+        viewer_draw(&viewer,
+            image_point(cam, window_size, screenshot_size, from),
+            image_point(cam, window_size, screenshot_size, to));
+        return;
+    }
+    if (tex->tiles == NULL) {
+        GL(glBindTexture(GL_TEXTURE_2D, pixmap_filtered ? pixmap_filtered : pixmap_texture.texture));
+        GL(glBindVertexArray(vao));
+        GL(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL));
+        GL(glBindVertexArray(0));
+        return;
+    }
 
-    size_t len;
-    ssize_t bytes_read = getdelim(&shaderSrc, &len, '\0', fp);
+    Vec2f img_size = { tex->width, tex->height };
+    texture_draw(tex,
+        image_point(cam, window_size, img_size, from),
+        image_point(cam, window_size, img_size, to));
+}
 
-    if (bytes_read < 0)
-        die("Unable to read shader file at '%s'.", name);
-    fclose(fp);
+/* Run the filters over whatever part of the screenshot is in view and
+ * changed since they last ran over it. Most frames this does nothing. Image
+ * files are shown as they are.
+ */
+void
+filter_screenshot(void)
+{
+    if (viewing)
+        return;
+    if (!zero_copy) {
+        texture_filter(&texture, &filters,
+            image_point(&camera, window_size, screenshot_size, ZERO),
+            image_point(&camera, window_size, screenshot_size, window_size));
+        return;
+    }
 
-    GLuint shader;
+    if (filters.count == 0) {
+        if (pixmap_filtered)
+            glDeleteTextures(1, &pixmap_filtered);
+        pixmap_filtered = 0;
+        return;
+    }
+    if (pixmap_generation == filters.generation)
+        return;
+
+    bool allocated = pixmap_filtered == 0;
+    filter_graph_apply(&filters, pixmap_texture.texture,
+        screenshot_size.x, screenshot_size.y, &pixmap_filtered);
+    pixmap_generation = filters.generation;
+    if (allocated)
+        set_sampling();
+}
 
-    shader = glCreateShader(type);
+/* Take a screenshot of `area` from `src` at (src_x, src_y) and get it onto
+ * the GPU, either bound directly from a pixmap or streamed in tiles. A
+ * capture that was already taken in the background is used as is.
+ */
+void
+open_screenshot(XRectangle area, Drawable src, int src_x, int src_y)
+{
+    XImage *screenshot = NULL;
 
-    glShaderSource(shader, 1, (const GLchar **)&shaderSrc, NULL);
-    glCompileShader(shader);
+    /* With zero copy the screen stays on the server and is bound as a
+     * texture directly, otherwise it is pulled to the client and uploaded.
+     */
+    zero_copy = capture.image == NULL && config.zero_copy && tfp_create(
+        dpy, screen, src, src_x, src_y, area.width, area.height, &pixmap_texture);
 
-    int sucess = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &sucess);
-    if (!sucess) {
-        GLchar infoLog[512];
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        die("Error comiling shader:\n%s", infoLog);
+    if (!zero_copy) {
+        if (capture.image == NULL) {
+            capture_open(dpy, &capture, src, src_x, src_y, area.width, area.height);
+            capture_dpy = dpy;
+        }
+        screenshot = capture.image;
     }
+    screenshot_size = (Vec2f) {area.width, area.height};
+    window_size = screenshot_size;
+    screenshot_area = area;
+
+    if (zero_copy) {
+        int sw = screenshot_size.x;
+        int sh = screenshot_size.y;
+
+        /* Pixmaps that aren't y-inverted have their first row at t = 1 */
+        float t0 = 0.0f, t1 = 1.0f;
+        if (!pixmap_texture.y_inverted) {
+            t0 = 1.0f;
+            t1 = 0.0f;
+        }
+
+        GLfloat vertices[] = {
+            //x     y   z       UV coords
+            sw,     0,  0.0,    1.0, t1, /* Top right */
+            sw,     sh, 0.0,    1.0, t0, /* Bottom right */
+            0,      sh, 0.0,    0.0, t0, /* Bottom left */
+            0,      0,  0.0,    0.0, t1  /* Top left */
+        };
+        /* Indecies of the triangles. 
+         * We want to fill a screen rect so we create two triangles:
+         * 3_____0
+         * |\    |
+         * |  \  |
+         * 2____\1
+         *
+         * Therefore we have two triangles, 0-1-3 and 1-2-3.
+         */
+        GLuint indices[] = {0, 1, 3, 1, 2, 3};
+
+        glGenVertexArrays(1, &quad_vao);
+        glGenBuffers(1, &quad_vbo);
+        glGenBuffers(1, &quad_ebo);
+
+        glBindVertexArray(quad_vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); 
+
+        GLsizei stride = 5 * sizeof(GLfloat);
+
+        /* Pos attribute = vec3(x, y, z) */
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+
+        /* UV attribute = vec2(x, y) */
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(0);
 
-    return shader;
+        glBindTexture(GL_TEXTURE_2D, pixmap_texture.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    } else {
+        /* The screenshot is streamed in over the first frames, at most
+         * upload_limit MiB per frame and starting with the tiles under the
+         * cursor, so a frame can be shown right away.
+         */
+        PixelFormat format;
+        pixel_format(&format, screenshot);
+
+        texture_create(&texture, screenshot->width, screenshot->height,
+            config.mipmaps && !config.low_memory);
+        texture_stream(&texture, screenshot->data, screenshot->bytes_per_line, &format);
+    }
+
+    set_sampling();
+
+    /* The fullscreen window covers everything there is to watch */
+    if (config.live && !config.windowed) {
+        fprintf(stderr, "Live mode needs windowed set, live mode disabled\n");
+    } else if (config.live) {
+        live_enabled = live_init(dpy, &live, DefaultRootWindow(dpy), w, area,
+            config.live_upload_limit * 1024.0f * 1024.0f);
+        if (!live_enabled)
+            fprintf(stderr, "XDamage is not available, live mode disabled\n");
+    }
+
+    glViewport(0, 0, area.width, area.height);
 }
 
+/* Show the image file in a window covering `area`, zoomed out until all of
+ * it fits. Nothing is read from the file yet, its tiles are streamed in as
+ * they come into view.
+ */
 void
-check_glx_version(Display *dpy)
+open_image(XRectangle area)
 {
-    int glx_major, glx_minor;
-    // Check shit if necessary
-    if (!glXQueryVersion(dpy, &glx_major, &glx_minor)
-        || (glx_minor == MIN_GLX_MAJOR && glx_minor < MIN_GLX_MINOR)
-        || (MIN_GLX_MAJOR < 1))
-        die("Invalid GLX version %d.%d. Requires GLX >= %d.%d", glx_major, glx_minor, MIN_GLX_MAJOR, MIN_GLX_MINOR);
+    screenshot_size = (Vec2f) {image.width, image.height};
+    window_size = (Vec2f) {area.width, area.height};
+    screenshot_area = area;
+    viewing = true;
+
+    viewer_create(&viewer, &image, config.vram_limit * 1024.0f * 1024.0f, window_size);
+    set_sampling();
+    camera.scale = MIN(1.0f, fit_image());
+
+    glViewport(0, 0, area.width, area.height);
+}
+
+/* Show frames read from the FIFO at `path`, or standard input without one,
+ * in a window covering `area`. Every frame taken is streamed into the
+ * texture like a screenshot, starting with the tiles in view; until the
+ * first one arrives the window stays black.
+ */
+void
+open_stream(XRectangle area, const char *path)
+{
+    screenshot_size = (Vec2f) {stream.width, stream.height};
+    window_size = (Vec2f) {area.width, area.height};
+    screenshot_area = area;
+    streaming = true;
+
+    texture_create(&texture, stream.width, stream.height, config.mipmaps && !config.low_memory);
+    set_sampling();
+    camera.scale = MIN(1.0f, fit_image());
+    stream_start(&stream, path);
+
+    glViewport(0, 0, area.width, area.height);
+}
+
+/* Let the camera zoom out far enough to show all of the image file.
+ * Returns the scale it fits at.
+ */
+float
+fit_image(void)
+{
+    float fit = MIN(window_size.x / screenshot_size.x, window_size.y / screenshot_size.y);
+
+    config.min_scale = MIN(config.min_scale, fit);
+    return fit;
+}
+
+void
+close_screenshot(void)
+{
+    tfp_destroy(dpy, &pixmap_texture);
+    if (pixmap_filtered)
+        glDeleteTextures(1, &pixmap_filtered);
+    pixmap_filtered = 0;
+    pixmap_generation = 0;
+    texture_destroy(&texture);
+    viewer_destroy(&viewer);
+    history_destroy(&history);
+    drop_capture();
+    live_destroy(dpy, &live);
+
+    if (quad_vao) {
+        glDeleteVertexArrays(1, &quad_vao);
+        glDeleteBuffers(1, &quad_vbo);
+        glDeleteBuffers(1, &quad_ebo);
+        quad_vao = quad_vbo = quad_ebo = 0;
+    }
+    zero_copy = live_enabled = viewing = streaming = false;
+}
+
+/* Pick what to zoom into, either the whole screen or a single monitor.
+ * Monitors are queried every time, they may have changed since.
+ */
+XRectangle
+choose_area(void)
+{
+    XGetWindowAttributes(dpy, DefaultRootWindow(dpy), &wa);
+
+    free(monitors);
+    monitor_count = monitors_query(dpy, &monitors);
+    current_monitor = MONITOR_ALL;
+    if (config.monitor == MONITOR_POINTER)
+        current_monitor = monitor_under_pointer(dpy, monitors, monitor_count);
+    else if (config.monitor >= 0)
+        current_monitor = MIN(config.monitor, monitor_count - 1);
+
+    if (current_monitor >= 0)
+        return monitor_area(current_monitor);
+    return (XRectangle) {0, 0, wa.width, wa.height};
+}
+
+/* Start looking at the screenshot from scratch */
+void
+reset_view(void)
+{
+    flashlight = (Flashlight) {
+        .is_enabled = false,
+        .shadow = 0.0f,
+        .radius = 200.0f,
+        .delta_radius = 0.0f,
+    };
+
+    /* Physics follow the clock, the refresh rate of the monitor being
+     * looked at only decides how long a frame is expected to take.
+     */
+    int rate_monitor = current_monitor;
+    if (rate_monitor < 0)
+        rate_monitor = monitor_under_pointer(dpy, monitors, monitor_count);
+    frame_time = 1.0f / monitors[rate_monitor].rate;
+
+    camera = (Camera) {
+        .position = ZERO,
+        .velocity = ZERO,
+        .scale_pivot = ZERO,
+        .scale = 1.0f,
+        .delta_scale = 0.0f,
+        .dt = frame_time,
+    };
 }
 
-// TODO: implement support for the MIT shared memory extension. (MIT-SHM)
-XImage*
-get_screenshot()
+/* Sample the screenshot the way the configuration asks for. Pixmaps bound
+ * with zero copy have no mip chain, they are at best sampled linearly.
+ */
+void
+set_sampling(void)
+{
+    if (viewing) {
+        viewer_set_sampling(&viewer, config.minify, config.magnify);
+        return;
+    }
+    if (zero_copy) {
+        GLuint ids[] = { pixmap_texture.texture, pixmap_filtered };
+        for (size_t i = 0; i < LENGTH(ids) && ids[i]; i++) {
+            glBindTexture(GL_TEXTURE_2D, ids[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampling_min_filter(config.minify, false));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling_mag_filter(config.magnify));
+        }
+        return;
+    }
+    texture_set_sampling(&texture, config.minify, config.magnify, config.anisotropy);
+}
+
+/* Free the captured image, along with the connection it was taken on */
+void
+drop_capture(void)
 {
-    return XGetImage(
-        dpy, w,
-        0, 0,
-        wa.width,
-        wa.height,
-        AllPlanes,
-        ZPixmap);
+    if (capture_dpy == NULL)
+        return;
+
+    capture_destroy(capture_dpy, &capture);
+    if (capture_dpy != dpy)
+        XCloseDisplay(capture_dpy);
+    capture_dpy = NULL;
 }
 
+/* Once every tile is on the GPU the captured image is dead weight, let it
+ * go and hand its pages back.
+ */
 void
-destroy_screenshot(XImage *screenshot)
+release_capture(void)
+{
+    if (config.history_limit > 0.0f)
+        start_history();
+    texture_release_source(&texture);
+    drop_capture();
+    malloc_trim(0);
+
+    if (report_memory)
+        memory_report("released", screenshot_bytes());
+}
+
+/* What the screenshot takes up on the GPU, a zero copy pixmap and its
+ * filtered copy count as four bytes per pixel.
+ */
+size_t
+screenshot_bytes(void)
 {
-    XDestroyImage(screenshot);
+    size_t bytes = filter_graph_bytes(&filters);
+
+    if (viewing)
+        return bytes + viewer_bytes(&viewer);
+    if (!zero_copy)
+        return bytes + texture_bytes(&texture);
+
+    bytes += (size_t)screenshot_size.x * screenshot_size.y * 4;
+    if (pixmap_filtered)
+        bytes += (size_t)screenshot_size.x * screenshot_size.y * 4;
+    return bytes;
 }
 
+XRectangle
+monitor_area(int index)
+{
+    Monitor *m = &monitors[index];
+
+    return (XRectangle) {m->x, m->y, m->width, m->height};
+}
+
+/* Move zooc to another monitor. The new monitor is captured from the root
+ * before the window moves there, so it never captures itself. Image files
+ * and streams stay where they are.
+ */
 void
-draw_image(Camera *cam, XImage *img, GLuint shader, GLuint vao,
-	Vec2f window_size, Mouse *mouse, Flashlight *fl)
+switch_monitor(int index)
 {
-    glClearColor(0.1, 0.1, 0.1, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (viewing || streaming || index == current_monitor || index < 0 || index >= monitor_count)
+        return;
+
+    XRectangle area = monitor_area(index);
+    Vec2f origin = {area.x, area.y};
+    Vec2f old_origin = ZERO;
+    if (current_monitor >= 0)
+        old_origin = (Vec2f) {monitors[current_monitor].x, monitors[current_monitor].y};
 
-    glUseProgram(shader);
+    close_screenshot();
+    open_screenshot(area, DefaultRootWindow(dpy), area.x, area.y);
+    XMoveResizeWindow(dpy, w, area.x, area.y, area.width, area.height);
 
-    glUniform2f(glGetUniformLocation(shader, "cameraPos"), cam->position.x, cam->position.y);
-    glUniform1f(glGetUniformLocation(shader, "cameraScale"), cam->scale);
-    glUniform2f(glGetUniformLocation(shader, "screenshotSize"), (float)img->width, (float)img->height);
-    glUniform2f(glGetUniformLocation(shader, "windowSize"), window_size.x, window_size.y);
-    glUniform2f(glGetUniformLocation(shader, "cursorPos"), mouse->current.x, mouse->current.y);
-    glUniform1f(glGetUniformLocation(shader, "flShadow"), fl->shadow);
-    glUniform1f(glGetUniformLocation(shader, "flRadius"), fl->radius);
+    current_monitor = index;
+    frame_time = 1.0f / monitors[index].rate;
+    camera = (Camera) {
+        .position = ZERO,
+        .velocity = ZERO,
+        .scale_pivot = ZERO,
+        .scale = 1.0f,
+        .delta_scale = 0.0f,
+        .dt = frame_time,
+    };
 
-    glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL);
+    /* Mouse positions are relative to the window */
+    mouse.current = mouse.previous = SUB(ADD(mouse.current, old_origin), origin);
+    mouse.dragging = false;
+}
+
+/* Sleep until the X connection or the input thread has something for us.
+ * The time spent asleep is accounted as skipped frames of `frame_time`
+ * seconds each.
+ */
+void
+wait_for_events(float frame_time)
+{
+    struct pollfd fds[5] = {
+        { .fd = ConnectionNumber(dpy), .events = POLLIN },
+        { .fd = ring.wake[0], .events = POLLIN },
+        { .fd = watch.fd, .events = POLLIN },
+        { .fd = streaming ? stream.wake[0] : -1, .events = POLLIN },
+        { .fd = listening, .events = POLLIN },
+    };
+
+    XFlush(dpy);
+    ring_clear_wake(&ring);
+    if (XPending(dpy) > 0 || !ring_empty(&ring))
+        return;
+
+    /* Shaders being built are checked on once a frame */
+    uint64_t start = now_ns();
+    poll(fds, LENGTH(fds), shader_build.active ? frame_time * 1000.0f : -1);
+
+    /* Rounded, truncating would lose every partial frame */
+    stats_skipped(llround((now_ns() - start) / 1e9 / frame_time));
+}
+
+/* Start building the shaders again, they replace the current ones once
+ * they are linked. A build still in progress is abandoned. The filters are
+ * small and rebuilt right away.
+ */
+void
+reload_shaders(void)
+{
+    shaders_cancel(&shader_build);
+    if (!shaders_build(&shader_build, config.vertex_shader_file, config.fragment_shader_file,
+            magnify_defines(config.magnify)))
+        fprintf(stderr, "Keeping the current shaders\n");
+    reload_filters();
+}
+
+/* Build the configured filter chain, the screenshot is filtered again on
+ * the next frame.
+ */
+void
+reload_filters(void)
+{
+    if (!filter_graph_load(&filters, config.filter_shader_file, config.filters))
+        fprintf(stderr, "Keeping the current filters\n");
+}
+
+/* Load the configuration again. A new magnification filter needs shaders
+ * built for it, other filters only a new chain.
+ */
+void
+reload_config(void)
+{
+    int magnify = config.magnify;
+    char old_filters[CONFIG_FILTERS_SIZE];
+
+    strcpy(old_filters, config.filters);
+    if (!load_config(&config)) {
+        fprintf(stderr, "Keeping the current configuration\n");
+        return;
+    }
+    if (viewing || streaming)
+        fit_image();
+    if (texture.tiles != NULL || zero_copy || viewing)
+        set_sampling();
+    if (config.magnify != magnify)
+        reload_shaders();
+    else if (strcmp(config.filters, old_filters))
+        reload_filters();
+}
+
+/* Pick up edits to the configuration and the shaders, and swap in shaders
+ * that finished building. Returns true when the frame has to be redrawn.
+ */
+bool
+reload(void)
+{
+    int changed = watch_read(&watch);
+
+    if (changed & WATCH_CONFIG)
+        reload_config();
+    if (changed & WATCH_SHADERS)
+        reload_shaders();
+
+    Shaders built;
+    if (shader_build.active && shaders_poll(&shader_build, &built) == SHADERS_READY) {
+        shaders_destroy(&shaders);
+        shaders = built;
+        render_init(&render, &shaders);
+        return true;
+    }
+    return changed != 0;
+}
+
+/* Apply an input record from the input thread. Motion is only recorded,
+ * anything else first applies the motion before it so it acts on the
+ * current position.
+ */
+void
+dispatch_input(InputRecord *r)
+{
+    stats.input_raw++;
+    present_input(&present, r->time);
+
+    switch (r->event.type) {
+    case MotionNotify:
+        motion_notify(&r->event);
+        break;
+    case INPUT_SCROLL:
+        scroll += r->clicks;
+        scroll_state = r->state;
+        break;
+    case KeyPress:
+    case ButtonPress:
+    case ButtonRelease:
+    case LeaveNotify:
+        apply_motion();
+        stats.input_applied++;
+        handler[r->event.type](&r->event);
+        break;
+    }
+}
+
+void
+leave_notify(XEvent *e)
+{
+    XCrossingEvent *ev;
+
+    ev = (XCrossingEvent*)&e->xcrossing;
+    if (config.monitor != MONITOR_POINTER || mouse.dragging || ev->mode != NotifyNormal)
+        return;
+
+    /* Leaving into a gap between the monitors keeps the current one */
+    int index = monitor_at(monitors, monitor_count, ev->x_root, ev->y_root);
+    if (index >= 0)
+        switch_monitor(index);
 }
 
 void
@@ -180,32 +810,144 @@ keypress(XEvent *e)
         camera.velocity = camera.position = (Vec2f) {0, 0};
         break;
     case XK_r:
-        config = load_config();
+        if (ev->state & ControlMask)
+            reload_shaders();
+        else
+            reload_config();
         break;
     case XK_f:
         flashlight.is_enabled = !flashlight.is_enabled;
         break;
+    case XK_s:
+        snapshot();
+        break;
+    case XK_c:
+        capture_history();
+        break;
+    case XK_bracketleft:
+        scrub(-1);
+        break;
+    case XK_bracketright:
+        scrub(1);
+        break;
+    case XK_m:
+        if (current_monitor >= 0)
+            switch_monitor((current_monitor + 1) % monitor_count);
+        break;
     }
 }
 
+/* Keep the first capture as the start of the history, while it is still
+ * around.
+ */
 void
-scroll_up(unsigned int delta, bool fl_enabled)
+start_history(void)
 {
-    if (delta > 0 && fl_enabled) {
-        flashlight.delta_radius += 250.0f;
+    XImage *image = capture.image;
+
+    if (history_active(&history) || image == NULL)
+        return;
+    history_init(&history, image->data, image->bytes_per_line, image->width, image->height,
+        image->bits_per_pixel / 8, config.history_limit * 1024.0f * 1024.0f);
+}
+
+/* Capture the area again, add it to the history and show it. A window
+ * covering the area is hidden while the screen is captured.
+ */
+void
+capture_history(void)
+{
+    Capture cap = {0};
+    PixelFormat format;
+
+    if (viewing || streaming) {
+        fprintf(stderr, "Only screenshots have a history\n");
+        return;
+    }
+    if (config.history_limit <= 0.0f || zero_copy) {
+        fprintf(stderr, "The history needs history_limit set and zero_copy off\n");
+        return;
+    }
+    start_history();
+    if (!history_active(&history))
+        return;
+
+    /* The window saves what is under it, which the server puts back as it
+     * handles the unmap, so the capture only waits for the UnmapNotify.
+     */
+    if (!config.windowed) {
+        XEvent ev;
+
+        XSelectInput(dpy, w, ExposureMask | StructureNotifyMask);
+        XUnmapWindow(dpy, w);
+        XWindowEvent(dpy, w, StructureNotifyMask, &ev);
+        while (ev.type != UnmapNotify)
+            XWindowEvent(dpy, w, StructureNotifyMask, &ev);
+        XSelectInput(dpy, w, ExposureMask);
+    }
+    capture_open(dpy, &cap, DefaultRootWindow(dpy), screenshot_area.x, screenshot_area.y,
+        screenshot_area.width, screenshot_area.height);
+    if (!config.windowed)
+        XMapWindow(dpy, w);
+
+    pixel_format(&format, cap.image);
+    if (format.layout != texture.format.layout
+        || format.bytes_per_pixel != texture.format.bytes_per_pixel
+        || format.red_mask != texture.format.red_mask
+        || format.green_mask != texture.format.green_mask
+        || format.blue_mask != texture.format.blue_mask
+        || format.msb_first != texture.format.msb_first) {
+        fprintf(stderr, "The capture has another pixel layout, it is not kept\n");
     } else {
-          camera.delta_scale += config.scroll_speed;
-          camera.scale_pivot = mouse.current;
+        history_add(&history, cap.image->data, cap.image->bytes_per_line, &texture);
+        history_report(&history);
     }
+    capture_destroy(dpy, &cap);
+}
+
+/* Show the capture `delta` steps away in the history */
+void
+scrub(int delta)
+{
+    if (!history_active(&history))
+        return;
+    history_seek(&history, delta, &texture);
+    history_report(&history);
+}
+
+/* Save the next frame, in snapshot_dir or else the home directory */
+void
+snapshot(void)
+{
+    const char *dir = config.snapshot_dir;
+
+    if (!*dir)
+        dir = getenv("HOME");
+    export_snapshot(&export, config.snapshot_format, dir != NULL ? dir : ".");
+}
+
+void
+scroll_up(unsigned int delta, bool fl_enabled)
+{
+    zoom(1.0f, delta > 0 && fl_enabled);
 }
 
 void
 scroll_down(unsigned int delta, bool fl_enabled)
 {
-    if (delta > 0 && fl_enabled) {
-        flashlight.delta_radius -= 250.0f;
+    zoom(-1.0f, delta > 0 && fl_enabled);
+}
+
+/* Zoom by `clicks` wheel clicks, fractional for smooth scrolling. Positive
+ * clicks zoom in or grow the flashlight.
+ */
+void
+zoom(float clicks, bool radius)
+{
+    if (radius) {
+        flashlight.delta_radius += 250.0f * clicks;
     } else {
-        camera.delta_scale -= config.scroll_speed;
+        camera.delta_scale += config.scroll_speed * clicks;
         camera.scale_pivot = mouse.current;
     }
 }
@@ -241,14 +983,28 @@ button_release(XEvent *e)
         mouse.dragging = false;
 }
 
+/* Motion only records where the pointer went, all the motion events of a
+ * frame are applied at once.
+ */
 void
 motion_notify(XEvent *e)
 {
     XMotionEvent *ev;
 
     ev = (XMotionEvent*)&e->xmotion;
+    pointer = (Vec2f) {ev->x, ev->y};
+    pointer_moved = true;
+}
+
+void
+apply_motion(void)
+{
+    if (!pointer_moved)
+        return;
+    pointer_moved = false;
+    stats.input_applied++;
 
-    mouse.current = (Vec2f) {ev->x, ev->y};
+    mouse.current = pointer;
     if (mouse.dragging) {
         Vec2f delta = SUB(world(&camera, mouse.previous), world(&camera, mouse.current));
         /* delta is the distance the mouse traveled in a single
@@ -261,23 +1017,356 @@ motion_notify(XEvent *e)
     mouse.previous = mouse.current;
 }
 
+/* Show the screenshot until the user is done with it */
+void
+run(void)
+{
+    XEvent e;
+    bool redraw = true;
+    bool idle = false;
+    bool first_frame = true;
+    uint64_t last_step = now_ns();
+
+    running = true;
+    export_begin(&export);
+    while (running) {
+        while (XPending(dpy) > 0) {
+            XNextEvent(dpy, &e);
+
+            /* Anything from expose to damage can change the frame */
+            redraw = true;
+
+            switch (e.type) {
+            case ClientMessage:
+                if ((Atom)e.xclient.data.l[0] == wm_delete_atom)
+                    running = false;
+                break;
+            default:
+                if (live_enabled)
+                    live_is_damage_event(&live, &e);
+                break;
+            }
+        }
+
+        InputRecord record;
+        while (ring_pop(&ring, &record)) {
+            redraw = true;
+            dispatch_input(&record);
+        }
+
+        if (reload())
+            redraw = true;
+        refuse_activations();
+
+        apply_motion();
+        if (scroll != 0.0f) {
+            stats.input_applied++;
+            zoom(scroll, (scroll_state & ControlMask) && flashlight.is_enabled);
+            scroll = 0.0f;
+        }
+
+        /* Only the newest frame is uploaded, older ones were dropped */
+        const unsigned char *frame;
+        uint64_t read_time;
+        if (streaming && (frame = stream_take(&stream, &read_time)) != NULL) {
+            texture_stream(&texture, (void *)frame, stream.stride, &stream.pixel_format);
+            stream_time = read_time;
+            redraw = true;
+        }
+
+        size_t uploaded = 0;
+        if (viewing) {
+            int level = viewer.shown;
+
+            uploaded += viewer_update(&viewer, camera.scale,
+                image_point(&camera, window_size, screenshot_size, ZERO),
+                image_point(&camera, window_size, screenshot_size, window_size),
+                image_point(&camera, window_size, screenshot_size, mouse.current),
+                config.upload_limit * 1024.0f * 1024.0f);
+
+            /* The last frame was drawn from another level */
+            if (viewer.shown != level)
+                redraw = true;
+        } else if (!zero_copy && !texture.complete) {
+            Vec2f view_min = image_point(&camera, window_size, screenshot_size, ZERO);
+            Vec2f view_max = image_point(&camera, window_size, screenshot_size, window_size);
+
+            /* Tiles out of view are only streamed in when the image is to
+             * be released as soon as possible.
+             */
+            if (config.low_memory) {
+                view_min = ZERO;
+                view_max = screenshot_size;
+            }
+            uploaded += texture_stream_step(&texture, config.upload_limit * 1024.0f * 1024.0f,
+                view_min, view_max,
+                image_point(&camera, window_size, screenshot_size, mouse.current));
+        }
+        if (!zero_copy && texture.complete && capture_dpy != NULL)
+            release_capture();
+        if (live_enabled) {
+            size_t updated = live_update(dpy, &live, &texture, zero_copy ? &pixmap_texture : NULL);
+
+            /* Uploaded tiles know they are stale, the pixmap does not */
+            if (updated > 0)
+                pixmap_generation = 0;
+            uploaded += updated;
+        }
+
+        /* Only render while something is moving or arriving, otherwise
+         * block until the next event.
+         */
+        bool animating = uploaded > 0
+            || (live_enabled && live.dirty)
+            || !camera_settled(&camera, &mouse)
+            || !flashlight_settled(&flashlight);
+
+        if (!redraw && !animating) {
+            present_flush(&present);
+            export_flush(&export);
+            wait_for_events(frame_time);
+            idle = true;
+            continue;
+        }
+        redraw = false;
+
+        /* Step by the time that actually passed since the last frame. Time
+         * spent blocked on events isn't motion, waking up counts as a
+         * single frame.
+         */
+        uint64_t now = now_ns();
+        camera.dt = idle ? frame_time : (now - last_step) / 1e9f;
+        last_step = now;
+        idle = false;
+
+        update_flashlight(&flashlight, camera.dt);
+        update_camera(&camera, &config, &mouse, window_size);
+
+        /* Mipmaps are only worth building once the image is shrunk */
+        if (camera.scale < 1.0f && config.minify == MINIFY_TRILINEAR && !zero_copy)
+            texture_build_mipmaps(&texture);
+
+        filter_screenshot();
+        draw_frame();
+
+        /* Read back before the swap leaves the back buffer undefined */
+        export_frame(&export, window_size.x, window_size.y);
+        present_swap(dpy, w, &present);
+        if (stream_time != 0) {
+            stats_stream_latency(now_ns() - stream_time);
+            stream_time = 0;
+        }
+        if (activation != -1) {
+            daemon_reply(activation, now_ns() - timings.start);
+            activation = -1;
+        }
+        if (timings.enabled) {
+            timing_end(STAGE_FIRST_FRAME);
+            timing_report();
+        }
+        if (first_frame && report_memory)
+            memory_report("first frame", screenshot_bytes());
+        first_frame = false;
+
+        stats_frame();
+    }
+}
+
+/* Answer activations that arrive while a session is shown right away, they
+ * would otherwise wait for it to end and report its length as latency.
+ */
+void
+refuse_activations(void)
+{
+    struct pollfd pfd = { .fd = listening, .events = POLLIN };
+    uint64_t sent;
+
+    while (listening != -1 && poll(&pfd, 1, 0) == 1) {
+        int client = daemon_accept(listening, &sent);
+        if (client == -1)
+            break;
+        daemon_reply(client, DAEMON_SHOWN);
+    }
+}
+
+/* Wait for activations while resident. Each one captures the screen, shows
+ * it until the user quits and then lets go of everything that was captured,
+ * only the connection, the hidden window, the context and the linked
+ * programs are kept between sessions.
+ */
+void
+serve(int fd, bool show_timings)
+{
+    struct pollfd fds[3] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = ConnectionNumber(dpy), .events = POLLIN },
+        { .fd = watch.fd, .events = POLLIN },
+    };
+
+    for (;;) {
+        XEvent e;
+        while (XPending(dpy) > 0)
+            XNextEvent(dpy, &e);
+        reload();
+
+        int timeout = shader_build.active ? frame_time * 1000.0f : -1;
+        if (poll(fds, LENGTH(fds), timeout) <= 0 || !(fds[0].revents & POLLIN))
+            continue;
+
+        uint64_t sent;
+        int client = daemon_accept(fd, &sent);
+        if (client == -1)
+            continue;
+
+        /* Timings of an activation count from when it was asked for */
+        timing_init(show_timings);
+        timings.start = sent;
+        activation = client;
+
+        /* The window is still unmapped, the root can be captured as is */
+        timing_begin(STAGE_UPLOAD);
+        XRectangle area = choose_area();
+        open_screenshot(area, DefaultRootWindow(dpy), area.x, area.y);
+        timing_end(STAGE_UPLOAD);
+        timing_begin(STAGE_FIRST_FRAME);
+
+        reset_view();
+        initialize_mouse(dpy, &mouse);
+        mouse.current = mouse.previous = SUB(mouse.current, ((Vec2f) {area.x, area.y}));
+        pointer = mouse.current;
+
+        XMoveResizeWindow(dpy, w, area.x, area.y, area.width, area.height);
+        XMapRaised(dpy, w);
+        listening = fd;
+        run();
+        listening = -1;
+
+        XUnmapWindow(dpy, w);
+        present_flush(&present);
+        close_screenshot();
+
+        /* Whatever is left of the session's input is stale */
+        InputRecord record;
+        while (ring_pop(&ring, &record))
+            ;
+        pointer_moved = false;
+        scroll = 0.0f;
+
+        /* Hand the pages of the screenshot back instead of keeping them */
+        malloc_trim(0);
+        XSync(dpy, False);
+        if (activation != -1) {
+            close(activation);
+            activation = -1;
+        }
+    }
+}
+
 int
 main(int argc, char *argv[])
 {
-    UNUSED(argv);
+    bool bench_capture = false;
+    bool bench_convert = false;
+    bool activate = false;
+    bool resident = false;
+    bool show_stats = false;
+    bool show_timings = false;
+    const char *record = NULL;
+    const char *file = NULL;
+    const char *stream_spec = NULL;
+    int bench_iterations = 0;
+
+    timing_init(false);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--bench-capture")) {
+            bench_capture = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                bench_iterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench-convert")) {
+            bench_convert = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                bench_iterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--daemon")) {
+            resident = true;
+        } else if (!strcmp(argv[i], "--activate")) {
+            activate = true;
+        } else if (!strcmp(argv[i], "--memory")) {
+            report_memory = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            show_stats = true;
+        } else if (!strcmp(argv[i], "--timings")) {
+            show_timings = true;
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            record = argv[++i];
+        } else if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+            stream_spec = argv[++i];
+        } else if (argv[i][0] != '-' && file == NULL) {
+            file = argv[i];
+        } else {
+            die("zooc-1.0\n"
+                    "Usage: zooc [--daemon | --activate] [--stats] [--timings] [--memory] [--record FILE] [--stream WxH:FORMAT] [--bench-capture [N]] [--bench-convert [N]] [FILE]\n"
+                    "\n"
+                    "For instructions on controls, try:\n"
+                    "$ man 1 zooc\n");
+        }
+    }
 
-    if (argc > 1) {
-        die("zooc-1.0\n"
-                "Usage: zooc\n"
-                "\n"
-                "For instructions on controls, try:\n"
-                "$ man 1 zooc\n");
+    if (bench_convert) {
+        convert_benchmark(bench_iterations);
+        return 0;
     }
-    config = load_config();
 
+    if ((file != NULL || stream_spec != NULL) && (resident || activate))
+        die("A resident zooc only shows the screen\n");
+
+    if (stream_spec != NULL && !stream_parse(&stream, stream_spec))
+        die("Unknown stream '%s', expected WIDTHxHEIGHT:FORMAT with a FORMAT of "
+            "bgra, rgba, bgr or rgb\n", stream_spec);
+
+    /* The file is only mapped, its pixels are read once they are shown. With
+     * a stream, it is the FIFO the frames come from.
+     */
+    if (file != NULL && stream_spec == NULL && !image_open(&image, file))
+        return 1;
+
+    /* Without a resident zooc to wake up, start as usual */
+    if (activate && daemon_activate(show_timings))
+        return 0;
+
+    timings.enabled = show_timings;
+
+    /* Capture and input run on threads of their own, with connections of
+     * their own, but still share Xlib's global state such as the error
+     * handler.
+     */
+    if (!XInitThreads())
+        die("Xlib has no support for threads\n");
+
+    timing_begin(STAGE_DISPLAY);
     dpy = XOpenDisplay(NULL);
     if (dpy == NULL)
         die("Cannot connect to the X display server\n");
+    timing_end(STAGE_DISPLAY);
+
+    if (bench_capture) {
+        capture_benchmark(dpy, bench_iterations);
+        XCloseDisplay(dpy);
+        return 0;
+    }
+
+    timing_begin(STAGE_CONFIG);
+    if (!load_config(&config))
+        die("Unable to load the configuration\n");
+    watch_init(&watch);
+    stats_init(show_stats);
+    timing_end(STAGE_CONFIG);
+
+    int listen_fd = -1;
+    if (resident)
+        listen_fd = daemon_listen();
+
+    timing_begin(STAGE_WINDOW);
     check_glx_version(dpy);
 
     screen = DefaultScreen(dpy);
@@ -297,225 +1386,132 @@ main(int argc, char *argv[])
     memset(&swa,0,sizeof(XSetWindowAttributes));
 
     swa.colormap = XCreateColormap(dpy, DefaultRootWindow(dpy), vi->visual, AllocNone);
-    swa.event_mask = ButtonPressMask 
-        | ButtonReleaseMask 
-        | KeyPressMask 
-        | KeyReleaseMask 
-        | PointerMotionMask 
-        | ClientMessage;
+    /* Input is selected on its own connection, see input_open */
+    swa.event_mask = ExposureMask;
 
     if (!config.windowed) {
         swa.override_redirect = 1;
         swa.save_under = 1;
     }
 
-    XGetWindowAttributes(dpy, DefaultRootWindow(dpy), &wa);
+    XRectangle area = choose_area();
+
+    /* The frozen screenshot doesn't need anything from GL, take it in the
+     * background while the window, context and shaders are set up. It is
+     * taken before our window is mapped, so it can never show up in it.
+     */
+    CaptureJob capture_job;
+    bool capturing = !resident && !config.zero_copy && file == NULL && stream_spec == NULL;
+    if (capturing)
+        capture_start(&capture_job, DisplayString(dpy), area);
 
     w = XCreateWindow(
         dpy, DefaultRootWindow(dpy), 
-        0, 0, wa.width, wa.height, 0,
+        area.x, area.y, area.width, area.height, 0,
         vi->depth, InputOutput, vi->visual,
         CWColormap | CWEventMask | CWOverrideRedirect | CWSaveUnder, &swa
     );
 
-    XMapWindow(dpy, w);
-
     char *wm_name  = "zooc";
     char *wm_class = "zooc";
     XClassHint hints = {.res_name = wm_name, .res_class = wm_class};
 
-    XStoreName(dpy, w, wm_name);
+    XStoreName(dpy, w, file != NULL ? file : wm_name);
     XSetClassHint(dpy, w, &hints);
 
-    Atom wm_delete_atom = XInternAtom(dpy, "WM_DELETE_WINDOW", 0);
+    wm_delete_atom = XInternAtom(dpy, "WM_DELETE_WINDOW", 0);
     XSetWMProtocols(dpy, w, &wm_delete_atom, 1);
 
+    timing_end(STAGE_WINDOW);
+
+    timing_begin(STAGE_CONTEXT);
     GLXContext glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
     glXMakeCurrent(dpy, w, glc);
 
     if (GLEW_OK != glewInit())
         die("Couldnt initialize glew!\n");
+    timing_end(STAGE_CONTEXT);
 
-    glViewport(0, 0, wa.width, wa.height);
-
-    XSelectInput(dpy, w, ButtonPressMask | ButtonReleaseMask | KeyPressMask | KeyReleaseMask | PointerMotionMask);
-
-    int revert_to_parent;
-    Window origin_win;
-
-    XGetInputFocus(dpy, &origin_win, &revert_to_parent);
-
-    GLuint vertex_shader;
-    GLuint fragment_shader;
-
-    /* Load and compile shaders */
-    vertex_shader   = load_shader(config.vertex_shader_file, GL_VERTEX_SHADER);
-    fragment_shader = load_shader(config.fragment_shader_file, GL_FRAGMENT_SHADER);
-
-    /* Link shaders and create a program */
-    GLuint shader_program = glCreateProgram();
-    glAttachShader(shader_program, vertex_shader);
-    glAttachShader(shader_program, fragment_shader);
-    glLinkProgram(shader_program);
-
-    int link_success;
-    glGetProgramiv(shader_program, GL_LINK_STATUS, &link_success);
-
-    if(!link_success) {
-        GLchar info_log[512];
-        glGetProgramInfoLog(shader_program, 512, NULL, info_log);
-        die("Error whilst linking program:\n%s", info_log);
-    }
-
-    XImage *screenshot = get_screenshot();
-    Vec2f screenshot_size = (Vec2f) {screenshot->width, screenshot->height};
-
-    int sw = screenshot_size.x;
-    int sh = screenshot_size.y;
-
-    GLuint vbo, vao, ebo;
-    GLfloat vertices[] = {
-        //x     y   z       UV coords
-        sw,     0,  0.0,    1.0, 1.0, /* Top right */
-        sw,     sh, 0.0,    1.0, 0.0, /* Bottom right */
-        0,      sh, 0.0,    0.0, 0.0, /* Bottom left */
-        0,      0,  0.0,    0.0, 1.0  /* Top left */
-    };
-    /* Indecies of the triangles. 
-     * We want to fill a screen rect so we create two triangles:
-     * 3_____0
-     * |\    |
-     * |  \  |
-     * 2____\1
-     *
-     * Therefore we have two triangles, 0-1-3 and 1-2-3.
+    /* Input is read by its own thread, which only ever hands records to
+     * this one. All of the camera, mouse and flashlight state stays here.
      */
-    GLuint indices[] = {0, 1, 3, 1, 2, 3};
-
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &ebo);
-
-    glBindVertexArray(vbo);
-
-    glBindVertexArray(vao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    ring_init(&ring);
+    input_open(&input, DisplayString(dpy), w, !config.windowed);
+    input_start(&input, &ring);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); 
+    /* The input thread takes the focus once it sees the window mapped */
+    if (!resident)
+        XMapWindow(dpy, w);
 
-    GLsizei stride = 5 * sizeof(GLfloat);
+    /* Load, compile and link every shader variant */
+    timing_begin(STAGE_SHADERS);
+    if (!shaders_load(&shaders, config.vertex_shader_file, config.fragment_shader_file,
+            magnify_defines(config.magnify)))
+        die("Unable to build the shaders\n");
+    timing_end(STAGE_SHADERS);
 
-    /* Pos attribute = vec3(x, y, z) */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-    glEnableVertexAttribArray(0);
+    if (!filter_graph_load(&filters, config.filter_shader_file, config.filters))
+        fprintf(stderr, "Unable to build the filters, showing the screenshot as is\n");
 
-    /* UV attribute = vec2(x, y) */
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
+    render_init(&render, &shaders);
+    present_init(dpy, screen, w, &present, config.present_mode);
 
-    GLuint texture = 0;
-    glGenTextures(1, &texture);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    glTexImage2D(
-        GL_TEXTURE_2D, 
-        0, 
-        GL_RGB, 
-        screenshot->width,
-        screenshot->height,
-        0,
-        GL_BGRA,
-        GL_UNSIGNED_BYTE,
-        screenshot->data
-    );
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    /* bind tex in the glsl code to be the loaded texture */
-    glUniform1i(glGetUniformLocation(shader_program, "tex"), 0);
-
     glEnable(GL_TEXTURE_2D);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    reset_view();
+    export_init(&export, record, 1.0f / frame_time);
 
-    XRRScreenConfiguration *screen_config = XRRGetScreenInfo(dpy, DefaultRootWindow(dpy));
-    float rate = 1.0f / XRRConfigCurrentRate(screen_config);
+    /* Resident, every activation is its own session from here on */
+    if (resident)
+        serve(listen_fd, show_timings);
 
-    flashlight = (Flashlight) {
-        .is_enabled = false,
-        .shadow = 0.0f,
-        .radius = 200.0f,
-        .delta_radius = 0.0f,
-    };
+    if (capturing) {
+        timing_begin(STAGE_JOIN);
+        capture_dpy = capture_finish(&capture_job, &capture);
+        timing_end(STAGE_JOIN);
+    }
 
-    camera = (Camera) {
-        .position = ZERO,
-        .velocity = ZERO,
-        .scale_pivot = ZERO,
-        .scale = 1.0f,
-        .delta_scale = 0.0f,
-        .dt = rate,
-    };
+    /* A frozen screenshot can be taken through our own, still transparent,
+     * window. Live mode has to keep reading what is underneath it.
+     */
+    timing_begin(STAGE_UPLOAD);
+    if (stream_spec != NULL)
+        open_stream(area, file);
+    else if (file != NULL)
+        open_image(area);
+    else if (config.live && config.windowed)
+        open_screenshot(area, DefaultRootWindow(dpy), area.x, area.y);
+    else
+        open_screenshot(area, w, 0, 0);
+    timing_end(STAGE_UPLOAD);
+    timing_begin(STAGE_FIRST_FRAME);
 
     initialize_mouse(dpy, &mouse);
+    mouse.current = mouse.previous = SUB(mouse.current, ((Vec2f) {area.x, area.y}));
+    pointer = mouse.current;
 
-    XEvent e;
-    while (running) {
-        // HACK: setting this every time is probably inefficient. Is there a 
-        // better way to maintain fullscreen input focus?
-        if (!config.windowed)
-            XSetInputFocus(dpy, w, RevertToParent, CurrentTime);
+    run();
 
-        while (XPending(dpy) > 0) {
-            XNextEvent(dpy, &e);
+    /* Releases the keyboard grab and gives the focus back */
+    input_destroy(&input);
+    ring_destroy(&ring);
 
-            switch (e.type) {
-            case ClientMessage:
-                if ((Atom)e.xclient.data.l[0] == wm_delete_atom)
-                    running = false;
-                break;
-            case KeyPress:
-            case ButtonPress:
-            case ButtonRelease:
-            case MotionNotify:
-                handler[e.type](&e);
-                break;
-            default:
-                break;
-            }
-        }
-
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        update_flashlight(&flashlight, camera.dt);
-        update_camera(&camera, &config, &mouse, screenshot_size);
-
-        glUseProgram(shader_program);
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        draw_image(&camera, screenshot, shader_program, vao, screenshot_size, &mouse, &flashlight);
-
-        glXSwapBuffers(dpy, w);
-        glFinish();
-    }
-
-    XSetInputFocus(dpy, origin_win, RevertToParent, CurrentTime);
-
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+    shaders_cancel(&shader_build);
+    shaders_destroy(&shaders);
+    watch_destroy(&watch);
+    export_destroy(&export);
+    stream_destroy(&stream);
+    close_screenshot();
+    image_close(&image);
+    filter_graph_destroy(&filters);
+    present_destroy(&present);
 
     glXMakeCurrent(dpy, None, NULL);
     glXDestroyContext(dpy, glc);
 
+    free(monitors);
+
     XCloseDisplay(dpy);
     return 0;
 }
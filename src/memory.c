@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+
+#define MIB (1024.0 * 1024.0)
+
+/* Read the current and the highest resident set size from procfs */
+bool
+memory_usage(MemoryUsage *usage)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    char line[256];
+    unsigned long kib;
+
+    memset(usage, 0, sizeof(*usage));
+    if (fp == NULL)
+        return false;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "VmRSS: %lu kB", &kib) == 1)
+            usage->rss = (size_t)kib * 1024;
+        else if (sscanf(line, "VmHWM: %lu kB", &kib) == 1)
+            usage->peak = (size_t)kib * 1024;
+    }
+    fclose(fp);
+    return true;
+}
+
+/* Print resident and peak memory along with the estimated size of the
+ * textures, labelled with `when` it was taken.
+ */
+void
+memory_report(const char *when, size_t texture_bytes)
+{
+    MemoryUsage usage;
+
+    if (!memory_usage(&usage)) {
+        fprintf(stderr, "memory (%s): unavailable\n", when);
+        return;
+    }
+    fprintf(stderr, "memory (%s): rss %.1f MiB  peak %.1f MiB  textures %.1f MiB\n",
+        when, usage.rss / MIB, usage.peak / MIB, texture_bytes / MIB);
+}
@@ -0,0 +1,16 @@
+#ifndef ZOOC_MEMORY_H
+#define ZOOC_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Resident memory of the process, in bytes */
+typedef struct {
+    size_t rss;
+    size_t peak;
+} MemoryUsage;
+
+bool memory_usage(MemoryUsage *);
+void memory_report(const char *, size_t);
+
+#endif
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "monitor.h"
+#include "util.h"
+
+#define FALLBACK_RATE 60.0f
+
+static float crtc_rate(Display *, XRRScreenResources *, RROutput);
+static float screen_rate(Display *);
+
+/* Refresh rate of the mode driving the CRTC of an output */
+static float
+crtc_rate(Display *dpy, XRRScreenResources *res, RROutput output)
+{
+    float rate = 0.0f;
+
+    XRROutputInfo *out = XRRGetOutputInfo(dpy, res, output);
+    if (out == NULL)
+        return 0.0f;
+
+    XRRCrtcInfo *crtc = out->crtc ? XRRGetCrtcInfo(dpy, res, out->crtc) : NULL;
+    for (int i = 0; crtc && i < res->nmode; i++) {
+        XRRModeInfo *mode = &res->modes[i];
+        if (mode->id != crtc->mode || !mode->hTotal || !mode->vTotal)
+            continue;
+
+        double lines = mode->vTotal;
+        if (mode->modeFlags & RR_DoubleScan)
+            lines *= 2.0;
+        if (mode->modeFlags & RR_Interlace)
+            lines /= 2.0;
+
+        rate = mode->dotClock / ((double)mode->hTotal * lines);
+        break;
+    }
+
+    if (crtc)
+        XRRFreeCrtcInfo(crtc);
+    XRRFreeOutputInfo(out);
+    return rate;
+}
+
+static float
+screen_rate(Display *dpy)
+{
+    XRRScreenConfiguration *conf = XRRGetScreenInfo(dpy, DefaultRootWindow(dpy));
+    if (conf == NULL)
+        return FALLBACK_RATE;
+
+    float rate = XRRConfigCurrentRate(conf);
+    XRRFreeScreenConfigInfo(conf);
+    return rate > 0.0f ? rate : FALLBACK_RATE;
+}
+
+/* List the active monitors (XRandR 1.5) with the refresh rate of their
+ * CRTC. When monitors aren't available the whole screen is reported as a
+ * single monitor. Returns the number of monitors, the array must be freed.
+ */
+int
+monitors_query(Display *dpy, Monitor **out)
+{
+    Window root = DefaultRootWindow(dpy);
+    int major = 0, minor = 0, count = 0;
+    XRRMonitorInfo *info = NULL;
+
+    if (XRRQueryVersion(dpy, &major, &minor) && (major > 1 || minor >= 5))
+        info = XRRGetMonitors(dpy, root, True, &count);
+
+    if (info == NULL || count <= 0) {
+        XWindowAttributes attrs;
+        XGetWindowAttributes(dpy, root, &attrs);
+
+        *out = malloc(sizeof(Monitor));
+        if (*out == NULL)
+            die("Malloc failed to allocate:");
+        **out = (Monitor) {0, 0, attrs.width, attrs.height, screen_rate(dpy)};
+        return 1;
+    }
+
+    *out = malloc(count * sizeof(Monitor));
+    if (*out == NULL)
+        die("Malloc failed to allocate:");
+
+    XRRScreenResources *res = XRRGetScreenResourcesCurrent(dpy, root);
+    for (int i = 0; i < count; i++) {
+        float rate = 0.0f;
+
+        /* Outputs of a monitor are clones, the first one decides */
+        if (res && info[i].noutput > 0)
+            rate = crtc_rate(dpy, res, info[i].outputs[0]);
+
+        (*out)[i] = (Monitor) {
+            .x = info[i].x,
+            .y = info[i].y,
+            .width  = info[i].width,
+            .height = info[i].height,
+            .rate = rate > 0.0f ? rate : screen_rate(dpy),
+        };
+    }
+
+    if (res)
+        XRRFreeScreenResources(res);
+    XRRFreeMonitors(info);
+    return count;
+}
+
+/* The monitor containing (x, y), or -1 when it falls in a gap between the
+ * monitors or off the screen.
+ */
+int
+monitor_at(const Monitor *monitors, int count, int x, int y)
+{
+    for (int i = 0; i < count; i++) {
+        if (BETWEEN(x, monitors[i].x, monitors[i].x + monitors[i].width - 1)
+            && BETWEEN(y, monitors[i].y, monitors[i].y + monitors[i].height - 1))
+            return i;
+    }
+    return -1;
+}
+
+/* The monitor closest to (x, y), which is the one containing it if any */
+int
+monitor_nearest(const Monitor *monitors, int count, int x, int y)
+{
+    long best_distance = -1;
+    int best = 0;
+
+    for (int i = 0; i < count; i++) {
+        long dx = x - CLAMP(monitors[i].x, x, monitors[i].x + monitors[i].width - 1);
+        long dy = y - CLAMP(monitors[i].y, y, monitors[i].y + monitors[i].height - 1);
+        long distance = dx * dx + dy * dy;
+
+        if (best_distance < 0 || distance < best_distance) {
+            best_distance = distance;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* The monitor under the pointer, or the closest one when it is between
+ * monitors
+ */
+int
+monitor_under_pointer(Display *dpy, const Monitor *monitors, int count)
+{
+    Window root, child;
+    int root_x = 0, root_y = 0, win_x, win_y;
+    unsigned int mask;
+
+    XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child,
+        &root_x, &root_y, &win_x, &win_y, &mask);
+    return monitor_nearest(monitors, count, root_x, root_y);
+}
@@ -0,0 +1,22 @@
+#ifndef ZOOC_MONITOR_H
+#define ZOOC_MONITOR_H
+
+#include <X11/Xlib.h>
+
+#define MONITOR_ALL      -2
+#define MONITOR_POINTER  -1
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+    float rate;
+} Monitor;
+
+int monitors_query(Display *, Monitor **);
+int monitor_at(const Monitor *, int, int, int);
+int monitor_nearest(const Monitor *, int, int, int);
+int monitor_under_pointer(Display *, const Monitor *, int);
+
+#endif
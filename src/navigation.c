@@ -8,17 +8,48 @@
 
 /* TODO: replace these with configurable constants */
 #define VELOCITY_THRESHOLD  15.0f
+#define SCALE_THRESHOLD     0.5f
+#define RADIUS_THRESHOLD    1.0f
 #define DELTA_RADIUS_DECEL  10.0f
 #define SHADOW_ACCEL        6.0f
 #define MAX_SHADOW          0.8f
 
+static float glide(float, float, float, float, float *);
+
+/* Closed form of a speed decaying under friction, v(t) = v * e^(-friction t),
+ * over `dt` seconds. Motion ends the moment the speed falls to `threshold`,
+ * so a single long step lands exactly where many short ones would.
+ * Returns the distance covered per unit of initial speed and stores the
+ * fraction of the speed that is left in `remaining`, zero once stopped.
+ */
+static float
+glide(float speed, float friction, float threshold, float dt, float *remaining)
+{
+    if (speed <= threshold) {
+        *remaining = 0.0f;
+        return 0.0f;
+    }
+    if (friction <= 0.0f) {
+        *remaining = 1.0f;
+        return dt;
+    }
+
+    float stop = logf(speed / threshold) / friction;
+    float t = MIN(dt, stop);
+    float decay = expf(-friction * t);
+
+    *remaining = t < dt ? 0.0f : decay;
+    return (1.0f - decay) / friction;
+}
+
 void
 update_flashlight(Flashlight *fl, float dt)
 {
-    if (fabsf(fl->delta_radius) > 1.0f) {
-        fl->radius = MAX(0.0f, fl->radius + fl->delta_radius * dt);
-        fl->delta_radius -= fl->delta_radius * DELTA_RADIUS_DECEL * dt;
-    }
+    float remaining;
+    float travel = glide(fabsf(fl->delta_radius), DELTA_RADIUS_DECEL, RADIUS_THRESHOLD, dt, &remaining);
+
+    fl->radius = MAX(0.0f, fl->radius + fl->delta_radius * travel);
+    fl->delta_radius *= remaining;
 
     /* Smoothly interpolate between on/off */
     if (fl->is_enabled)
@@ -27,6 +58,15 @@ update_flashlight(Flashlight *fl, float dt)
         fl->shadow = MAX(fl->shadow - SHADOW_ACCEL * dt , 0.0f);
 }
 
+/* True when update_flashlight would leave the flashlight untouched */
+bool
+flashlight_settled(Flashlight *fl)
+{
+    float target = fl->is_enabled ? MAX_SHADOW : 0.0f;
+
+    return fabsf(fl->delta_radius) <= RADIUS_THRESHOLD && fl->shadow == target;
+}
+
 void
 initialize_mouse(Display *dpy, Mouse *m)
 {
@@ -54,22 +94,43 @@ initialize_mouse(Display *dpy, Mouse *m)
     m->dragging = false;
 }
 
+/* Advance the camera by cam->dt seconds. Zoom and pan coast to a stop under
+ * exponential friction, evaluated in closed form so the result only depends
+ * on the time that passed and not on how many frames it was split into.
+ */
 void
 update_camera(Camera *cam, Config *config, Mouse *mouse, Vec2f window_size)
 {
-    if (fabsf(cam->delta_scale) > 0.5f) {
+    float remaining;
+    float travel = glide(fabsf(cam->delta_scale), config->scale_friction,
+        SCALE_THRESHOLD, cam->dt, &remaining);
+
+    if (travel > 0.0f) {
+        /* The pivot stays put on screen, which only depends on the scale
+         * before and after the step.
+         */
         Vec2f p0 = DIVS(SUB(cam->scale_pivot, MULS(window_size, 0.5)), cam->scale);
-        cam->scale = CLAMP(config->min_scale, cam->scale + cam->delta_scale * cam->dt, config->max_scale);
+        cam->scale = CLAMP(config->min_scale, cam->scale + cam->delta_scale * travel, config->max_scale);
         Vec2f p1 = DIVS(SUB(cam->scale_pivot, MULS(window_size, 0.5)), cam->scale);
         cam->position = ADD(cam->position, SUB(p0, p1));
-
-        cam->delta_scale -= cam->delta_scale * cam->dt * config->scale_friction;
     }
+    cam->delta_scale *= remaining;
 
-    if (!mouse->dragging && LEN(cam->velocity) > VELOCITY_THRESHOLD) {
-        cam->position = ADD(cam->position, MULS(cam->velocity, cam->dt));
-        cam->velocity = SUB(cam->velocity, MULS(cam->velocity, cam->dt * config->drag_friction));
-    }
+    if (mouse->dragging)
+        return;
+
+    travel = glide(LEN(cam->velocity), config->drag_friction,
+        VELOCITY_THRESHOLD, cam->dt, &remaining);
+    cam->position = ADD(cam->position, MULS(cam->velocity, travel));
+    cam->velocity = MULS(cam->velocity, remaining);
+}
+
+/* True when update_camera would leave the camera untouched */
+bool
+camera_settled(Camera *cam, Mouse *mouse)
+{
+    return fabsf(cam->delta_scale) <= SCALE_THRESHOLD
+        && (mouse->dragging || LEN(cam->velocity) <= VELOCITY_THRESHOLD);
 }
 
 Vec2f
@@ -77,3 +138,13 @@ world(Camera *cam, Vec2f v)
 {
     return DIVS(v, cam->scale);
 }
+
+/* Map a point in window coordinates to the screenshot pixel under it, this is
+ * the inverse of the transform in vertex.glsl.
+ */
+Vec2f
+image_point(Camera *cam, Vec2f window_size, Vec2f img_size, Vec2f p)
+{
+    Vec2f offset = DIVS(SUB(p, MULS(window_size, 0.5f)), cam->scale);
+    return ADD(ADD(MULS(img_size, 0.5f), cam->position), offset);
+}
@@ -33,6 +33,9 @@ typedef struct {
 } Mouse;
 
 Vec2f world(Camera *, Vec2f);
+bool camera_settled(Camera *, Mouse *);
+bool flashlight_settled(Flashlight *);
+Vec2f image_point(Camera *, Vec2f, Vec2f, Vec2f);
 void initialize_mouse(Display *, Mouse *);
 void update_camera(Camera *, Config *, Mouse *, Vec2f);
 void update_flashlight(Flashlight *, float);
@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <X11/Xlib.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+#include "present.h"
+#include "stats.h"
+#include "util.h"
+
+typedef void (*SwapIntervalEXT)(Display *, GLXDrawable, int);
+typedef int (*SwapIntervalMESA)(unsigned int);
+
+static bool set_interval(Display *, int, GLXDrawable, int);
+static bool retire(Present *, bool);
+
+static const char *mode_names[PRESENT_MODE_COUNT] = {
+    [PRESENT_VSYNC]    = "vsync",
+    [PRESENT_ADAPTIVE] = "adaptive",
+    [PRESENT_LATENCY]  = "latency",
+};
+
+const char *
+present_mode_name(PresentMode mode)
+{
+    return mode < PRESENT_MODE_COUNT ? mode_names[mode] : "unknown";
+}
+
+/* Prefer GLX_EXT_swap_control, which is per drawable and understands the
+ * negative intervals of swap_control_tear. GLX_MESA_swap_control only takes
+ * plain intervals.
+ */
+static bool
+set_interval(Display *dpy, int screen, GLXDrawable drawable, int interval)
+{
+    const char *extensions = glXQueryExtensionsString(dpy, screen);
+
+    if (has_extension(extensions, "GLX_EXT_swap_control")) {
+        SwapIntervalEXT swap_interval = (SwapIntervalEXT)
+            glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+        if (swap_interval != NULL) {
+            swap_interval(dpy, drawable, interval);
+            return true;
+        }
+    }
+
+    if (interval >= 0 && has_extension(extensions, "GLX_MESA_swap_control")) {
+        SwapIntervalMESA swap_interval = (SwapIntervalMESA)
+            glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+        if (swap_interval != NULL)
+            return swap_interval(interval) == 0;
+    }
+    return false;
+}
+
+/* vsync waits for every vertical blank and lets the driver queue a frame
+ * ahead. adaptive does the same but swaps right away when a frame misses
+ * the blank. latency doesn't wait for the blank at all and never has more
+ * than one frame in flight, input shows up as soon as the GPU is done.
+ */
+void
+present_init(Display *dpy, int screen, GLXDrawable drawable, Present *p, PresentMode mode)
+{
+    *p = (Present) {
+        .mode = mode,
+        .interval = 1,
+        .max_frames = PRESENT_MAX_FRAMES,
+    };
+
+    switch (mode) {
+    case PRESENT_ADAPTIVE:
+        if (has_extension(glXQueryExtensionsString(dpy, screen), "GLX_EXT_swap_control_tear"))
+            p->interval = -1;
+        else
+            fprintf(stderr, "GLX_EXT_swap_control_tear is not available, using vsync\n");
+        break;
+    case PRESENT_LATENCY:
+        p->interval = 0;
+        p->max_frames = 1;
+        break;
+    default:
+        break;
+    }
+
+    if (!set_interval(dpy, screen, drawable, p->interval))
+        fprintf(stderr, "Swap control is not available, using the driver's swap interval\n");
+}
+
+/* Note input that arrived at `time`, the next frame is the first to show
+ * it
+ */
+void
+present_input(Present *p, uint64_t time)
+{
+    if (p->pending_input == 0 || time < p->pending_input)
+        p->pending_input = time;
+}
+
+/* Drop the oldest frame in flight once it is done, waiting for it when
+ * `wait` is set. Returns whether it was done.
+ */
+static bool
+retire(Present *p, bool wait)
+{
+    if (p->count == 0)
+        return false;
+
+    GLsync fence = p->fences[p->head];
+    GLenum status = glClientWaitSync(fence,
+        wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? UINT64_MAX : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    if (p->inputs[p->head] != 0)
+        stats_gpu_latency(now_ns() - p->inputs[p->head]);
+
+    glDeleteSync(fence);
+    p->head = (p->head + 1) % PRESENT_MAX_FRAMES;
+    p->count--;
+    return true;
+}
+
+/* Swap and fence the frame, then block until fewer than max_frames are in
+ * flight. With two frames allowed this only waits on the previous frame,
+ * where glFinish would stall on the one just submitted.
+ */
+void
+present_swap(Display *dpy, GLXDrawable drawable, Present *p)
+{
+    GL(glXSwapBuffers(dpy, drawable));
+
+    if (!GLEW_ARB_sync) {
+        if (p->max_frames == 1)
+            GL(glFinish());
+        p->pending_input = 0;
+        return;
+    }
+
+    int tail = (p->head + p->count) % PRESENT_MAX_FRAMES;
+    p->fences[tail] = GL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    p->inputs[tail] = p->pending_input;
+    p->pending_input = 0;
+    p->count++;
+
+    while (retire(p, false))
+        ;
+    while (p->count >= p->max_frames)
+        retire(p, true);
+}
+
+/* Wait for every frame in flight, before going idle */
+void
+present_flush(Present *p)
+{
+    while (retire(p, true))
+        ;
+}
+
+void
+present_destroy(Present *p)
+{
+    for (; p->count > 0; p->count--) {
+        glDeleteSync(p->fences[p->head]);
+        p->head = (p->head + 1) % PRESENT_MAX_FRAMES;
+    }
+}
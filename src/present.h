@@ -0,0 +1,45 @@
+#ifndef ZOOC_PRESENT_H
+#define ZOOC_PRESENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+#define PRESENT_MAX_FRAMES 2
+
+typedef enum {
+    PRESENT_VSYNC,
+    PRESENT_ADAPTIVE,
+    PRESENT_LATENCY,
+    PRESENT_MODE_COUNT,
+} PresentMode;
+
+/* Swap interval and the fences of the frames still in flight. Each frame
+ * remembers when the first input it shows arrived, so the time until the
+ * GPU is done with it can be reported.
+ */
+typedef struct {
+    PresentMode mode;
+    int interval;
+    int max_frames;
+
+    GLsync fences[PRESENT_MAX_FRAMES];
+    uint64_t inputs[PRESENT_MAX_FRAMES];
+    int head;
+    int count;
+
+    uint64_t pending_input;
+} Present;
+
+const char *present_mode_name(PresentMode);
+void present_init(Display *, int, GLXDrawable, Present *, PresentMode);
+void present_input(Present *, uint64_t);
+void present_swap(Display *, GLXDrawable, Present *);
+void present_flush(Present *);
+void present_destroy(Present *);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdbool.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "navigation.h"
+#include "render.h"
+#include "shader.h"
+#include "stats.h"
+#include "vec.h"
+
+static void uniform1f(GLint, GLfloat *, GLfloat, bool);
+static void uniform2f(GLint, Vec2f *, Vec2f, bool);
+static void program_init(RenderProgram *, GLuint);
+
+static void
+uniform1f(GLint location, GLfloat *last, GLfloat value, bool force)
+{
+    if (location < 0 || (!force && *last == value))
+        return;
+
+    GL(glUniform1f(location, value));
+    *last = value;
+}
+
+static void
+uniform2f(GLint location, Vec2f *last, Vec2f value, bool force)
+{
+    if (location < 0 || (!force && EQ(*last, value)))
+        return;
+
+    GL(glUniform2f(location, value.x, value.y));
+    *last = value;
+}
+
+static void
+program_init(RenderProgram *p, GLuint program)
+{
+    *p = (RenderProgram) {
+        .program         = program,
+        .camera_pos      = glGetUniformLocation(program, "cameraPos"),
+        .camera_scale    = glGetUniformLocation(program, "cameraScale"),
+        .screenshot_size = glGetUniformLocation(program, "screenshotSize"),
+        .window_size     = glGetUniformLocation(program, "windowSize"),
+        .cursor_pos      = glGetUniformLocation(program, "cursorPos"),
+        .fl_shadow       = glGetUniformLocation(program, "flShadow"),
+        .fl_radius       = glGetUniformLocation(program, "flRadius"),
+        .synced          = false,
+    };
+
+    /* The sampler never changes, the screenshot always sits in unit 0 */
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "tex"), 0);
+}
+
+/* Look up the uniforms of freshly linked programs. Has to be called again
+ * whenever they are rebuilt, every uniform is then sent on first use.
+ */
+void
+render_init(RenderState *r, const Shaders *shaders)
+{
+    for (int i = 0; i < SHADER_VARIANT_COUNT; i++)
+        program_init(&r->programs[i], shaders->programs[i]);
+    r->current = 0;
+
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+}
+
+void
+render_clear(RenderState *r)
+{
+    GL(glClear(GL_COLOR_BUFFER_BIT));
+    r->current = 0;
+}
+
+/* Bind a variant and bring its uniforms up to date, leaving it ready for
+ * the screenshot to be drawn.
+ */
+void
+render_use(RenderState *r, ShaderVariant variant, Camera *cam, Mouse *mouse,
+        Flashlight *fl, Vec2f img_size, Vec2f window_size)
+{
+    RenderProgram *p = &r->programs[variant];
+    bool force = !p->synced;
+
+    if (r->current != p->program) {
+        GL(glUseProgram(p->program));
+        r->current = p->program;
+    }
+
+    uniform2f(p->camera_pos, &p->last_camera_pos, cam->position, force);
+    uniform1f(p->camera_scale, &p->last_camera_scale, cam->scale, force);
+    uniform2f(p->screenshot_size, &p->last_screenshot_size, img_size, force);
+    uniform2f(p->window_size, &p->last_window_size, window_size, force);
+    uniform2f(p->cursor_pos, &p->last_cursor_pos, mouse->current, force);
+    uniform1f(p->fl_shadow, &p->last_fl_shadow, fl->shadow, force);
+    uniform1f(p->fl_radius, &p->last_fl_radius, fl->radius, force);
+
+    p->synced = true;
+}
@@ -0,0 +1,47 @@
+#ifndef ZOOC_RENDER_H
+#define ZOOC_RENDER_H
+
+#include <stdbool.h>
+
+#include <GL/gl.h>
+
+#include "navigation.h"
+#include "shader.h"
+#include "vec.h"
+
+/* Uniform locations of a linked program, resolved once, together with the
+ * values last sent to it so unchanged uniforms are never uploaded again.
+ */
+typedef struct {
+    GLuint program;
+
+    GLint camera_pos;
+    GLint camera_scale;
+    GLint screenshot_size;
+    GLint window_size;
+    GLint cursor_pos;
+    GLint fl_shadow;
+    GLint fl_radius;
+
+    Vec2f last_camera_pos;
+    GLfloat last_camera_scale;
+    Vec2f last_screenshot_size;
+    Vec2f last_window_size;
+    Vec2f last_cursor_pos;
+    GLfloat last_fl_shadow;
+    GLfloat last_fl_radius;
+
+    /* False until every uniform has been sent to the program */
+    bool synced;
+} RenderProgram;
+
+typedef struct {
+    RenderProgram programs[SHADER_VARIANT_COUNT];
+    GLuint current;
+} RenderState;
+
+void render_init(RenderState *, const Shaders *);
+void render_clear(RenderState *);
+void render_use(RenderState *, ShaderVariant, Camera *, Mouse *, Flashlight *, Vec2f, Vec2f);
+
+#endif
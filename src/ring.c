@@ -0,0 +1,85 @@
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "ring.h"
+#include "util.h"
+
+void
+ring_init(InputRing *r)
+{
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+
+    if (pipe(r->wake) < 0)
+        die("Unable to create the input pipe:");
+
+    /* Neither end may ever block, the pipe only signals */
+    for (int i = 0; i < 2; i++)
+        fcntl(r->wake[i], F_SETFL, fcntl(r->wake[i], F_GETFL) | O_NONBLOCK);
+}
+
+/* Producer side. Returns false, dropping the record, when the consumer has
+ * fallen a whole ring behind.
+ */
+bool
+ring_push(InputRing *r, const InputRecord *record)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if (tail - head == RING_SIZE)
+        return false;
+
+    r->records[tail & (RING_SIZE - 1)] = *record;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+    /* A full pipe already wakes the consumer */
+    char byte = 0;
+    ssize_t n = write(r->wake[1], &byte, 1);
+    UNUSED(n);
+    return true;
+}
+
+/* Consumer side, returns false when the ring is empty */
+bool
+ring_pop(InputRing *r, InputRecord *record)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if (head == tail)
+        return false;
+
+    *record = r->records[head & (RING_SIZE - 1)];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool
+ring_empty(InputRing *r)
+{
+    return atomic_load_explicit(&r->head, memory_order_relaxed)
+        == atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+/* Consumer side, empty the wake pipe before checking the ring and going to
+ * sleep on it.
+ */
+void
+ring_clear_wake(InputRing *r)
+{
+    char buf[64];
+
+    while (read(r->wake[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+void
+ring_destroy(InputRing *r)
+{
+    close(r->wake[0]);
+    close(r->wake[1]);
+}
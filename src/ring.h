@@ -0,0 +1,44 @@
+#ifndef ZOOC_RING_H
+#define ZOOC_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+
+/* Must be a power of two */
+#define RING_SIZE       1024
+
+/* Record type of smooth scrolling, past every core event type */
+#define INPUT_SCROLL    LASTEvent
+
+/* An input event as it was received, with the time it arrived. Scrolling
+ * records carry their wheel clicks and modifier state instead of an event.
+ */
+typedef struct {
+    uint64_t time;
+    XEvent event;
+    float clicks;
+    unsigned int state;
+} InputRecord;
+
+/* Lock-free queue with exactly one producer and one consumer. The consumer
+ * can sleep on `wake[0]`, which becomes readable after every push.
+ */
+typedef struct {
+    InputRecord records[RING_SIZE];
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    int wake[2];
+} InputRing;
+
+void ring_init(InputRing *);
+bool ring_push(InputRing *, const InputRecord *);
+bool ring_pop(InputRing *, InputRecord *);
+bool ring_empty(InputRing *);
+void ring_clear_wake(InputRing *);
+void ring_destroy(InputRing *);
+
+#endif
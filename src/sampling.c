@@ -0,0 +1,67 @@
+#include <stdbool.h>
+
+#include <GL/gl.h>
+
+#include "sampling.h"
+
+static const char *minify_names[MINIFY_COUNT] = {
+    [MINIFY_NEAREST]   = "nearest",
+    [MINIFY_LINEAR]    = "linear",
+    [MINIFY_TRILINEAR] = "trilinear",
+};
+
+static const char *magnify_names[MAGNIFY_COUNT] = {
+    [MAGNIFY_NEAREST] = "nearest",
+    [MAGNIFY_LINEAR]  = "linear",
+    [MAGNIFY_BICUBIC] = "bicubic",
+    [MAGNIFY_LANCZOS] = "lanczos",
+};
+
+const char *
+minify_name(Minify minify)
+{
+    return minify < MINIFY_COUNT ? minify_names[minify] : "unknown";
+}
+
+const char *
+magnify_name(Magnify magnify)
+{
+    return magnify < MAGNIFY_COUNT ? magnify_names[magnify] : "unknown";
+}
+
+/* Defines the shaders are built with, see fragment.glsl */
+const char *
+magnify_defines(Magnify magnify)
+{
+    switch (magnify) {
+    case MAGNIFY_BICUBIC:
+        return "#define BICUBIC\n";
+    case MAGNIFY_LANCZOS:
+        return "#define LANCZOS\n";
+    default:
+        return "";
+    }
+}
+
+/* Trilinear filtering needs the mip chain, until it is built the texture
+ * is sampled linearly.
+ */
+GLenum
+sampling_min_filter(Minify minify, bool mipmapped)
+{
+    switch (minify) {
+    case MINIFY_TRILINEAR:
+        return mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    case MINIFY_LINEAR:
+        return GL_LINEAR;
+    default:
+        return GL_NEAREST;
+    }
+}
+
+/* The shader filters read texels themselves and want them unfiltered */
+GLenum
+sampling_mag_filter(Magnify magnify)
+{
+    return magnify == MAGNIFY_LINEAR ? GL_LINEAR : GL_NEAREST;
+}
@@ -0,0 +1,33 @@
+#ifndef ZOOC_SAMPLING_H
+#define ZOOC_SAMPLING_H
+
+#include <stdbool.h>
+
+#include <GL/gl.h>
+
+/* How the screenshot is sampled while zoomed out */
+typedef enum {
+    MINIFY_NEAREST,
+    MINIFY_LINEAR,
+    MINIFY_TRILINEAR,
+    MINIFY_COUNT,
+} Minify;
+
+/* How the screenshot is sampled while zoomed in. Bicubic and Lanczos are
+ * done in the fragment shader.
+ */
+typedef enum {
+    MAGNIFY_NEAREST,
+    MAGNIFY_LINEAR,
+    MAGNIFY_BICUBIC,
+    MAGNIFY_LANCZOS,
+    MAGNIFY_COUNT,
+} Magnify;
+
+const char *minify_name(Minify);
+const char *magnify_name(Magnify);
+const char *magnify_defines(Magnify);
+GLenum sampling_min_filter(Minify, bool);
+GLenum sampling_mag_filter(Magnify);
+
+#endif
@@ -0,0 +1,487 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "shader.h"
+#include "util.h"
+
+#define CACHE_MAGIC     0x7a6f6f63u    /* "zooc" */
+#define MAX_PATH_SIZE   4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+} CacheHeader;
+
+static char *read_source(const char *);
+static const char *find_version(const char *);
+static GLuint compile_shader(const char *, GLenum, const char *);
+static GLuint link_program(GLuint, GLuint, bool);
+static void report_errors(GLuint, GLuint, GLuint);
+static ShaderStatus finish(ShaderBuild *, Shaders *, bool);
+static uint64_t hash(uint64_t, const char *);
+static bool cache_path(char *, size_t, uint64_t);
+static GLuint cache_load(const char *);
+static void cache_store(const char *, GLuint);
+static uint64_t driver_key(void);
+
+static const char *variant_defines[SHADER_VARIANT_COUNT] = {
+    [SHADER_PLAIN]      = "#define PLAIN\n",
+    [SHADER_DIM]        = "#define DIM\n",
+    [SHADER_FLASHLIGHT] = "#define FLASHLIGHT\n",
+};
+
+static char *
+read_source(const char *name)
+{
+    FILE *fp = fopen(name, "r");
+    char *src = NULL;
+    size_t len = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open shader file at '%s': %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    ssize_t bytes_read = getdelim(&src, &len, '\0', fp);
+    fclose(fp);
+
+    if (bytes_read < 0) {
+        fprintf(stderr, "Unable to read shader file at '%s'.\n", name);
+        free(src);
+        return NULL;
+    }
+    return src;
+}
+
+/* The #version directive of `src`, or NULL without one. Like any directive
+ * it starts a line, a "#version" in a comment or after code doesn't count.
+ */
+static const char *
+find_version(const char *src)
+{
+    bool line_start = true;
+
+    for (const char *c = src; *c; c++) {
+        if (c[0] == '/' && c[1] == '/') {
+            c += strcspn(c, "\n");
+            if (*c == '\0')
+                break;
+            line_start = true;
+        } else if (c[0] == '/' && c[1] == '*') {
+            const char *end = strstr(c + 2, "*/");
+            if (end == NULL)
+                break;
+            c = end + 1;
+        } else if (*c == '\n') {
+            line_start = true;
+        } else if (*c == '#' && line_start) {
+            const char *name = c + 1 + strspn(c + 1, " \t");
+            if (!strncmp(name, "version", 7) && isspace((unsigned char)name[7]))
+                return c;
+            line_start = false;
+        } else if (!isspace((unsigned char)*c)) {
+            line_start = false;
+        }
+    }
+    return NULL;
+}
+
+/* Start compiling `src` with `defines` inserted right after its #version
+ * line, which has to stay the first statement of the shader. Errors show up
+ * when the program it is linked into fails, see report_errors.
+ */
+static GLuint
+compile_shader(const char *src, GLenum type, const char *defines)
+{
+    const char *body = src;
+    const char *version = find_version(src);
+    if (version != NULL) {
+        body = version + strcspn(version, "\n");
+        if (*body == '\n')
+            body++;
+    }
+
+    const GLchar *parts[] = { src, defines, body };
+    GLint lengths[] = { body - src, strlen(defines), -1 };
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, LENGTH(parts), parts, lengths);
+    glCompileShader(shader);
+    return shader;
+}
+
+static GLuint
+link_program(GLuint vertex_shader, GLuint fragment_shader, bool retrievable)
+{
+    GLuint program = glCreateProgram();
+    if (retrievable)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    return program;
+}
+
+/* Print why a program failed to link, starting with its shaders */
+static void
+report_errors(GLuint program, GLuint vertex_shader, GLuint fragment_shader)
+{
+    GLuint stages[] = { vertex_shader, fragment_shader };
+    GLchar info_log[512];
+    int success = 0;
+
+    for (size_t i = 0; i < LENGTH(stages); i++) {
+        if (stages[i] == 0)
+            continue;
+        glGetShaderiv(stages[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(stages[i], sizeof(info_log), NULL, info_log);
+            fprintf(stderr, "Error compiling shader:\n%s", info_log);
+        }
+    }
+
+    glGetProgramInfoLog(program, sizeof(info_log), NULL, info_log);
+    fprintf(stderr, "Error whilst linking program:\n%s", info_log);
+}
+
+/* 64 bit FNV-1a, continued from `h` */
+static uint64_t
+hash(uint64_t h, const char *s)
+{
+    for (; s && *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* Programs are only valid for the driver that linked them */
+static uint64_t
+driver_key(void)
+{
+    uint64_t key = 0xcbf29ce484222325ull;
+    key = hash(key, (const char *)glGetString(GL_VENDOR));
+    key = hash(key, (const char *)glGetString(GL_RENDERER));
+    key = hash(key, (const char *)glGetString(GL_VERSION));
+    return key;
+}
+
+/* Cached programs live in $XDG_CACHE_HOME/zooc, named after their key */
+static bool
+cache_path(char *path, size_t size, uint64_t key)
+{
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[MAX_PATH_SIZE];
+
+    if (cache_home != NULL && *cache_home)
+        snprintf(dir, sizeof(dir), "%s", cache_home);
+    else if (home != NULL)
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    else
+        return false;
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+        return false;
+    strncat(dir, "/zooc", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+        return false;
+
+    snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+    return true;
+}
+
+/* Returns the program stored at `path`, or 0 when there is none or the
+ * driver rejects it, for instance after an update.
+ */
+static GLuint
+cache_load(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return 0;
+
+    CacheHeader header;
+    void *binary = NULL;
+    GLuint program = 0;
+
+    if (fread(&header, sizeof(header), 1, fp) == 1
+        && header.magic == CACHE_MAGIC
+        && (binary = malloc(header.length)) != NULL
+        && fread(binary, header.length, 1, fp) == 1) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, header.length);
+
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    free(binary);
+    fclose(fp);
+    return program;
+}
+
+/* Write the binary to a temporary file next to `path` and rename it into
+ * place, so other instances see either the old file or the whole new one.
+ */
+static void
+cache_store(const char *path, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    CacheHeader header = { .magic = CACHE_MAGIC, .length = length };
+    void *binary = malloc(length);
+    if (binary == NULL)
+        return;
+
+    GLenum format;
+    glGetProgramBinary(program, length, NULL, &format, binary);
+    header.format = format;
+
+    char tmp[MAX_PATH_SIZE];
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp);
+    if (fd != -1) {
+        FILE *fp = fdopen(fd, "wb");
+        bool written = fp != NULL
+            && fwrite(&header, sizeof(header), 1, fp) == 1
+            && fwrite(binary, length, 1, fp) == 1;
+
+        if (fp != NULL)
+            written &= fclose(fp) == 0;
+        else
+            close(fd);
+
+        if (!written || rename(tmp, path) == -1)
+            unlink(tmp);
+    }
+    free(binary);
+}
+
+/* Start building every variant of the program, with `defines` added to
+ * each. The fragment shader picks its path with #ifdef, shaders that don't
+ * know about variants simply end up the same in all of them.
+ *
+ * Linked programs are cached on disk, keyed by both sources, the variant
+ * and the driver. Only variants missing from the cache are compiled.
+ * Returns false when the sources can't be read.
+ */
+bool
+shaders_build(ShaderBuild *b, const char *vertex_file, const char *fragment_file,
+        const char *defines)
+{
+    static bool threads_set = false;
+
+    memset(b, 0, sizeof(*b));
+
+    char *vertex_src = read_source(vertex_file);
+    char *fragment_src = read_source(fragment_file);
+    if (vertex_src == NULL || fragment_src == NULL) {
+        free(vertex_src);
+        free(fragment_src);
+        return false;
+    }
+
+    /* Let the driver use as many threads as it likes */
+    if (GLEW_ARB_parallel_shader_compile && !threads_set) {
+        glMaxShaderCompilerThreadsARB(0xffffffff);
+        threads_set = true;
+    }
+
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    uint64_t key = driver_key();
+    key = hash(key, vertex_src);
+    key = hash(key, fragment_src);
+    key = hash(key, defines);
+
+    for (int i = 0; i < SHADER_VARIANT_COUNT; i++) {
+        char path[MAX_PATH_SIZE];
+        uint64_t variant_key = hash(key, variant_defines[i]);
+        bool cached = formats > 0 && cache_path(path, sizeof(path), variant_key);
+
+        b->shaders.programs[i] = cached ? cache_load(path) : 0;
+        if (b->shaders.programs[i])
+            continue;
+
+        if (b->vertex_shader == 0)
+            b->vertex_shader = compile_shader(vertex_src, GL_VERTEX_SHADER, "");
+
+        char fragment_defines[256];
+        snprintf(fragment_defines, sizeof(fragment_defines), "%s%s", variant_defines[i], defines);
+
+        b->fragment_shaders[i] = compile_shader(fragment_src, GL_FRAGMENT_SHADER, fragment_defines);
+        b->shaders.programs[i] = link_program(b->vertex_shader, b->fragment_shaders[i], cached);
+        if (cached)
+            b->keys[i] = variant_key;
+    }
+
+    free(vertex_src);
+    free(fragment_src);
+    b->active = true;
+    return true;
+}
+
+/* Collect the programs once every one of them is linked. Without `wait`
+ * this returns SHADERS_PENDING instead of blocking on the driver.
+ */
+static ShaderStatus
+finish(ShaderBuild *b, Shaders *out, bool wait)
+{
+    GLuint *programs = b->shaders.programs;
+
+    if (!b->active)
+        return SHADERS_FAILED;
+
+    for (int i = 0; !wait && GLEW_ARB_parallel_shader_compile && i < SHADER_VARIANT_COUNT; i++) {
+        int done = 0;
+        glGetProgramiv(programs[i], GL_COMPLETION_STATUS_ARB, &done);
+        if (!done)
+            return SHADERS_PENDING;
+    }
+
+    bool ok = true;
+    for (int i = 0; ok && i < SHADER_VARIANT_COUNT; i++) {
+        int success = 0;
+        glGetProgramiv(programs[i], GL_LINK_STATUS, &success);
+        if (!success) {
+            report_errors(programs[i], b->vertex_shader, b->fragment_shaders[i]);
+            ok = false;
+        }
+    }
+
+    for (int i = 0; ok && i < SHADER_VARIANT_COUNT; i++) {
+        char path[MAX_PATH_SIZE];
+        if (b->keys[i] && cache_path(path, sizeof(path), b->keys[i]))
+            cache_store(path, programs[i]);
+    }
+
+    if (ok) {
+        *out = b->shaders;
+        memset(&b->shaders, 0, sizeof(b->shaders));
+    }
+    shaders_cancel(b);
+    return ok ? SHADERS_READY : SHADERS_FAILED;
+}
+
+ShaderStatus
+shaders_poll(ShaderBuild *b, Shaders *out)
+{
+    return finish(b, out, false);
+}
+
+/* Throw away whatever is left of a build */
+void
+shaders_cancel(ShaderBuild *b)
+{
+    for (int i = 0; i < SHADER_VARIANT_COUNT; i++) {
+        /* Cached programs never had shaders attached */
+        if (b->fragment_shaders[i] == 0)
+            continue;
+        if (b->shaders.programs[i]) {
+            glDetachShader(b->shaders.programs[i], b->vertex_shader);
+            glDetachShader(b->shaders.programs[i], b->fragment_shaders[i]);
+        }
+        glDeleteShader(b->fragment_shaders[i]);
+    }
+    if (b->vertex_shader)
+        glDeleteShader(b->vertex_shader);
+
+    shaders_destroy(&b->shaders);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Build every variant right away */
+bool
+shaders_load(Shaders *s, const char *vertex_file, const char *fragment_file,
+        const char *defines)
+{
+    ShaderBuild b;
+
+    if (!shaders_build(&b, vertex_file, fragment_file, defines))
+        return false;
+    return finish(&b, s, true) == SHADERS_READY;
+}
+
+/* Build a program whose stages both come from `file`, compiled with
+ * VERTEX or FRAGMENT defined after `defines`. Goes through the same cache
+ * as the variants. Returns 0 and reports why when it fails.
+ */
+GLuint
+shader_program(const char *file, const char *defines)
+{
+    char *src = read_source(file);
+    if (src == NULL)
+        return 0;
+
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    char path[MAX_PATH_SIZE];
+    uint64_t key = hash(hash(driver_key(), src), defines);
+    bool cached = formats > 0 && cache_path(path, sizeof(path), key);
+
+    GLuint program = cached ? cache_load(path) : 0;
+    if (program) {
+        free(src);
+        return program;
+    }
+
+    char vertex_defines[256], fragment_defines[256];
+    snprintf(vertex_defines, sizeof(vertex_defines), "%s#define VERTEX\n", defines);
+    snprintf(fragment_defines, sizeof(fragment_defines), "%s#define FRAGMENT\n", defines);
+
+    GLuint vertex_shader = compile_shader(src, GL_VERTEX_SHADER, vertex_defines);
+    GLuint fragment_shader = compile_shader(src, GL_FRAGMENT_SHADER, fragment_defines);
+    program = link_program(vertex_shader, fragment_shader, cached);
+    free(src);
+
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        report_errors(program, vertex_shader, fragment_shader);
+        glDeleteProgram(program);
+        program = 0;
+    } else {
+        glDetachShader(program, vertex_shader);
+        glDetachShader(program, fragment_shader);
+        if (cached)
+            cache_store(path, program);
+    }
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    return program;
+}
+
+void
+shaders_destroy(Shaders *s)
+{
+    for (int i = 0; i < SHADER_VARIANT_COUNT; i++) {
+        if (s->programs[i])
+            glDeleteProgram(s->programs[i]);
+        s->programs[i] = 0;
+    }
+}
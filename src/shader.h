@@ -0,0 +1,48 @@
+#ifndef ZOOC_SHADER_H
+#define ZOOC_SHADER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <GL/gl.h>
+
+/* Programs built from the same sources with a different define each */
+typedef enum {
+    SHADER_PLAIN,
+    SHADER_DIM,
+    SHADER_FLASHLIGHT,
+    SHADER_VARIANT_COUNT,
+} ShaderVariant;
+
+typedef struct {
+    GLuint programs[SHADER_VARIANT_COUNT];
+} Shaders;
+
+typedef enum {
+    SHADERS_PENDING,
+    SHADERS_READY,
+    SHADERS_FAILED,
+} ShaderStatus;
+
+/* Programs that are still being compiled and linked. With a parallel shader
+ * compiler the driver does so on its own threads, otherwise the work is done
+ * once the build is polled.
+ */
+typedef struct {
+    bool active;
+    Shaders shaders;
+    GLuint vertex_shader;
+    GLuint fragment_shaders[SHADER_VARIANT_COUNT];
+
+    /* Cache keys of the variants to store once linked, 0 for none */
+    uint64_t keys[SHADER_VARIANT_COUNT];
+} ShaderBuild;
+
+bool shaders_build(ShaderBuild *, const char *, const char *, const char *);
+ShaderStatus shaders_poll(ShaderBuild *, Shaders *);
+void shaders_cancel(ShaderBuild *);
+bool shaders_load(Shaders *, const char *, const char *, const char *);
+void shaders_destroy(Shaders *);
+GLuint shader_program(const char *, const char *);
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+#include "util.h"
+
+#define REPORT_INTERVAL_NS 1000000000ull
+
+static void report(void);
+
+Stats stats;
+
+void
+stats_init(bool enabled)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.enabled = enabled;
+    stats.window_start = now_ns();
+}
+
+/* Print the counters once the report interval has passed */
+static void
+report(void)
+{
+    if (!stats.enabled)
+        return;
+
+    uint64_t now = now_ns();
+    uint64_t elapsed = now - stats.window_start;
+    if (elapsed < REPORT_INTERVAL_NS)
+        return;
+
+    double seconds = elapsed / 1e9;
+    fprintf(stderr, "fps %6.1f  skipped %6.1f/s  upload %8.2f MiB/s  gl %6.1f/frame"
+        "  input to gpu %6.2f ms  input %5.1f/%5.1f per frame  export dropped %llu"
+        "  stream %5.1f/s dropped %llu latency %6.2f ms\n",
+        stats.frames / seconds,
+        stats.frames_skipped / seconds,
+        stats.upload_bytes / seconds / (1024.0 * 1024.0),
+        stats.frames ? (double)stats.gl_calls / stats.frames : 0.0,
+        stats.gpu_latency_samples ? stats.gpu_latency_ns / 1e6 / stats.gpu_latency_samples : 0.0,
+        stats.frames ? (double)stats.input_raw / stats.frames : 0.0,
+        stats.frames ? (double)stats.input_applied / stats.frames : 0.0,
+        (unsigned long long)stats.export_dropped,
+        stats.stream_frames / seconds,
+        (unsigned long long)stats.stream_dropped,
+        stats.stream_latency_samples ? stats.stream_latency_ns / 1e6 / stats.stream_latency_samples : 0.0);
+
+    stats_init(true);
+}
+
+/* Account for a rendered frame */
+void
+stats_frame(void)
+{
+    stats.frames++;
+    report();
+}
+
+/* Account for frames that weren't rendered because nothing changed */
+void
+stats_skipped(uint64_t frames)
+{
+    stats.frames_skipped += frames;
+    report();
+}
+
+/* Account for the time between input arriving and the GPU finishing the
+ * frame showing it. It stops short of the frame reaching the screen, which
+ * GLX doesn't tell us about.
+ */
+void
+stats_gpu_latency(uint64_t ns)
+{
+    stats.gpu_latency_ns += ns;
+    stats.gpu_latency_samples++;
+}
+
+/* Account for the time between a streamed frame being read in full and the
+ * first frame showing it being swapped
+ */
+void
+stats_stream_latency(uint64_t ns)
+{
+    stats.stream_latency_ns += ns;
+    stats.stream_latency_samples++;
+}
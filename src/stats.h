@@ -0,0 +1,40 @@
+#ifndef ZOOC_STATS_H
+#define ZOOC_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Counters reported once per second on stderr when running with --stats.
+ * Every counter is reset after it is reported.
+ */
+typedef struct {
+    bool enabled;
+    uint64_t window_start;
+
+    uint64_t frames;
+    uint64_t frames_skipped;
+    uint64_t upload_bytes;
+    uint64_t gl_calls;
+    uint64_t gpu_latency_ns;
+    uint64_t gpu_latency_samples;
+    uint64_t input_raw;
+    uint64_t input_applied;
+    uint64_t export_dropped;
+    uint64_t stream_frames;
+    uint64_t stream_dropped;
+    uint64_t stream_latency_ns;
+    uint64_t stream_latency_samples;
+} Stats;
+
+/* Issue a GL call from the frame path and count it */
+#define GL(call)    (stats.gl_calls++, (call))
+
+extern Stats stats;
+
+void stats_init(bool);
+void stats_frame(void);
+void stats_skipped(uint64_t);
+void stats_gpu_latency(uint64_t);
+void stats_stream_latency(uint64_t);
+
+#endif
@@ -0,0 +1,244 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+
+#include "convert.h"
+#include "stats.h"
+#include "stream.h"
+#include "util.h"
+
+static void publish(Stream *);
+static void *read_frames(void *);
+
+static const char *format_names[STREAM_FORMAT_COUNT] = {
+    [STREAM_BGRA] = "bgra",
+    [STREAM_RGBA] = "rgba",
+    [STREAM_BGR]  = "bgr",
+    [STREAM_RGB]  = "rgb",
+};
+
+const char *
+stream_format_name(StreamFormat format)
+{
+    return format < STREAM_FORMAT_COUNT ? format_names[format] : "unknown";
+}
+
+/* Read the size and format of the frames from a WIDTHxHEIGHT:FORMAT spec,
+ * such as 1920x1080:bgra.
+ */
+bool
+stream_parse(Stream *s, const char *spec)
+{
+    char name[16];
+    int n = 0;
+
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->wake[0] = s->wake[1] = -1;
+
+    if (sscanf(spec, "%dx%d:%15[a-z]%n", &s->width, &s->height, name, &n) != 3
+        || spec[n] != '\0' || s->width < 1 || s->height < 1)
+        return false;
+
+    s->format = STREAM_FORMAT_COUNT;
+    for (int i = 0; i < STREAM_FORMAT_COUNT; i++) {
+        if (!strcmp(name, stream_format_name(i)))
+            s->format = i;
+    }
+    if (s->format == STREAM_FORMAT_COUNT)
+        return false;
+
+    /* Described the way an XImage would be, so the conversion kernels for
+     * X visuals can take the frames as they are.
+     */
+    bool rgb = s->format == STREAM_RGBA || s->format == STREAM_RGB;
+    XImage layout = {
+        .bits_per_pixel = s->format == STREAM_BGRA || s->format == STREAM_RGBA ? 32 : 24,
+        .byte_order = LSBFirst,
+        .red_mask   = rgb ? 0xff : 0xff0000,
+        .green_mask = 0xff00,
+        .blue_mask  = rgb ? 0xff0000 : 0xff,
+    };
+    pixel_format(&s->pixel_format, &layout);
+
+    s->stride = (size_t)s->width * s->pixel_format.bytes_per_pixel;
+    s->frame_bytes = s->stride * s->height;
+    return true;
+}
+
+/* Hand the frame just read over as the newest one, dropping the one it
+ * replaces if it was never taken.
+ */
+static void
+publish(Stream *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->times[s->writing] = now_ns();
+
+    int done = s->writing;
+    s->writing = s->ready;
+    s->ready = done;
+
+    if (s->fresh)
+        s->dropped++;
+    s->fresh = true;
+    s->received++;
+    pthread_mutex_unlock(&s->lock);
+
+    /* A full pipe already wakes the render thread */
+    char byte = 0;
+    ssize_t n = write(s->wake[1], &byte, 1);
+    UNUSED(n);
+}
+
+/* Reader thread. A FIFO is opened without blocking, so zooc starts before
+ * anything writes to it; reads only happen once poll says there is data,
+ * which lets the quit pipe interrupt the wait.
+ */
+static void *
+read_frames(void *arg)
+{
+    Stream *s = arg;
+    const char *name = s->path != NULL ? s->path : "standard input";
+    size_t filled = 0;
+
+    if (s->path != NULL) {
+        s->fd = open(s->path, O_RDONLY | O_NONBLOCK);
+        if (s->fd == -1)
+            fprintf(stderr, "%s: %s\n", s->path, strerror(errno));
+    }
+
+    while (s->fd != -1) {
+        struct pollfd fds[2] = {
+            { .fd = s->fd, .events = POLLIN },
+            { .fd = s->quit[0], .events = POLLIN },
+        };
+
+        if (poll(fds, LENGTH(fds), -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            return NULL;
+
+        ssize_t n = read(s->fd, s->buffers[s->writing] + filled, s->frame_bytes - filled);
+        if (n == -1 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (n == -1)
+            fprintf(stderr, "Reading %s failed: %s\n", name, strerror(errno));
+        if (n <= 0)
+            break;
+
+        filled += n;
+        if (filled == s->frame_bytes) {
+            publish(s);
+            filled = 0;
+        }
+    }
+
+    if (s->fd != -1)
+        fprintf(stderr, "End of %s, keeping the last frame\n", name);
+    char byte = 0;
+    ssize_t n = write(s->wake[1], &byte, 1);
+    UNUSED(n);
+    return NULL;
+}
+
+/* Start reading frames from the FIFO at `path`, or standard input when it
+ * is NULL.
+ */
+void
+stream_start(Stream *s, const char *path)
+{
+    s->path = path;
+    if (path == NULL)
+        s->fd = STDIN_FILENO;
+
+    for (int i = 0; i < STREAM_BUFFER_COUNT; i++) {
+        s->buffers[i] = malloc(s->frame_bytes);
+        if (s->buffers[i] == NULL)
+            die("Malloc failed to allocate:");
+    }
+    s->writing = 0;
+    s->ready = 1;
+    s->reading = 2;
+
+    if (pipe(s->wake) < 0 || pipe(s->quit) < 0)
+        die("Unable to create the stream pipes:");
+
+    /* The wake pipe only signals, neither end may block */
+    for (int i = 0; i < 2; i++)
+        fcntl(s->wake[i], F_SETFL, fcntl(s->wake[i], F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_init(&s->lock, NULL);
+    if (pthread_create(&s->thread, NULL, read_frames, s) != 0)
+        die("Unable to start the stream thread\n");
+    s->started = true;
+}
+
+/* Take the newest frame if it wasn't taken yet. It stays valid until the
+ * next frame is taken. Stores when it was read in full in `time`.
+ */
+const unsigned char *
+stream_take(Stream *s, uint64_t *time)
+{
+    char buf[64];
+
+    while (read(s->wake[0], buf, sizeof(buf)) > 0)
+        ;
+
+    pthread_mutex_lock(&s->lock);
+    if (!s->fresh) {
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+    }
+
+    int taken = s->ready;
+    s->ready = s->reading;
+    s->reading = taken;
+    s->fresh = false;
+
+    stats.stream_frames++;
+    stats.stream_dropped += s->dropped - s->reported;
+    s->reported = s->dropped;
+    pthread_mutex_unlock(&s->lock);
+
+    *time = s->times[taken];
+    return s->buffers[taken];
+}
+
+void
+stream_destroy(Stream *s)
+{
+    if (!s->started)
+        return;
+
+    char byte = 0;
+    ssize_t n = write(s->quit[1], &byte, 1);
+    UNUSED(n);
+    pthread_join(s->thread, NULL);
+
+    fprintf(stderr, "Streamed %llu frames, %llu dropped\n",
+        (unsigned long long)s->received, (unsigned long long)s->dropped);
+
+    if (s->path != NULL && s->fd != -1)
+        close(s->fd);
+    for (int i = 0; i < 2; i++) {
+        close(s->wake[i]);
+        close(s->quit[i]);
+    }
+    for (int i = 0; i < STREAM_BUFFER_COUNT; i++)
+        free(s->buffers[i]);
+
+    pthread_mutex_destroy(&s->lock);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,64 @@
+#ifndef ZOOC_STREAM_H
+#define ZOOC_STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "convert.h"
+
+#define STREAM_BUFFER_COUNT 3
+
+/* Byte order of the pixels in memory */
+typedef enum {
+    STREAM_BGRA,
+    STREAM_RGBA,
+    STREAM_BGR,
+    STREAM_RGB,
+    STREAM_FORMAT_COUNT,
+} StreamFormat;
+
+/* Raw frames of a fixed size read from standard input or a FIFO. A reader
+ * thread fills one buffer while the newest complete frame waits in the
+ * second and the render thread uploads from the third. Taking a frame swaps
+ * the last two, nothing is copied. A frame still waiting when the next one
+ * is complete is dropped, so zooc never falls behind the source.
+ */
+typedef struct {
+    int width;
+    int height;
+    StreamFormat format;
+    PixelFormat pixel_format;
+    size_t stride;
+    size_t frame_bytes;
+
+    const char *path;
+    int fd;
+    pthread_t thread;
+    bool started;
+    int quit[2];
+
+    /* Readable after every complete frame and at the end of the stream */
+    int wake[2];
+
+    pthread_mutex_t lock;
+    unsigned char *buffers[STREAM_BUFFER_COUNT];
+    uint64_t times[STREAM_BUFFER_COUNT];
+    int writing;
+    int ready;
+    int reading;
+    bool fresh;
+
+    uint64_t received;
+    uint64_t dropped;
+    uint64_t reported;
+} Stream;
+
+const char *stream_format_name(StreamFormat);
+bool stream_parse(Stream *, const char *);
+void stream_start(Stream *, const char *);
+const unsigned char *stream_take(Stream *, uint64_t *);
+void stream_destroy(Stream *);
+
+#endif
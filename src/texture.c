@@ -0,0 +1,599 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "filter.h"
+#include "sampling.h"
+#include "stats.h"
+#include "texture.h"
+#include "util.h"
+#include "vec.h"
+
+/* Size of a single band streamed through one PBO */
+#define BAND_BYTES          (4 << 20)
+#define BYTES_PER_PIXEL     4
+
+static void allocate_tile(Texture *, Tile *);
+static void apply_sampling(Texture *, Tile *);
+static void build_tile_mipmaps(Texture *, Tile *);
+static void build_geometry(Texture *);
+static int mip_levels(int, int);
+static Tile *next_tile(Texture *, Vec2f, Vec2f, Vec2f);
+static bool tile_visible(Tile *, Vec2f, Vec2f);
+static void upload_rect(Texture *, Tile *, int, int, int, int, const unsigned char *, size_t);
+static void invalidate_filtered(Texture *, int, int, int, int);
+static void gather_apron(Texture *, int, int, int, int);
+
+static int
+mip_levels(int width, int height)
+{
+    int levels = 1;
+
+    for (int size = MAX(width, height); size > 1; size >>= 1)
+        levels++;
+    return levels;
+}
+
+static bool
+tile_visible(Tile *tile, Vec2f min, Vec2f max)
+{
+    return tile->x < max.x && min.x < tile->x + tile->width
+        && tile->y < max.y && min.y < tile->y + tile->height;
+}
+
+/* Every tile gets its own quad in a shared vertex buffer, so drawing tile i
+ * is a single glDrawElements at index offset 6 * i. Quads are laid out like
+ * the single screenshot quad: image row r sits at y = height - r.
+ */
+static void
+build_geometry(Texture *t)
+{
+    int count = t->cols * t->rows;
+    GLfloat *vertices = malloc(count * 4 * 5 * sizeof(GLfloat));
+    GLuint *indices   = malloc(count * 6 * sizeof(GLuint));
+
+    if (vertices == NULL || indices == NULL)
+        die("Malloc failed to allocate:");
+
+    for (int i = 0; i < count; i++) {
+        Tile *tile = &t->tiles[i];
+        GLfloat x0 = tile->x, x1 = tile->x + tile->width;
+        GLfloat y0 = t->height - tile->y - tile->height;
+        GLfloat y1 = t->height - tile->y;
+
+        GLfloat quad[] = {
+            x1, y0, 0.0,    1.0, 1.0,
+            x1, y1, 0.0,    1.0, 0.0,
+            x0, y1, 0.0,    0.0, 0.0,
+            x0, y0, 0.0,    0.0, 1.0,
+        };
+        GLuint base = 4 * i;
+        GLuint quad_indices[] = {base, base + 1, base + 3, base + 1, base + 2, base + 3};
+
+        memcpy(vertices + i * LENGTH(quad), quad, sizeof(quad));
+        memcpy(indices + i * LENGTH(quad_indices), quad_indices, sizeof(quad_indices));
+    }
+
+    glGenVertexArrays(1, &t->vao);
+    glGenBuffers(1, &t->vbo);
+    glGenBuffers(1, &t->ebo);
+
+    glBindVertexArray(t->vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, t->vbo);
+    glBufferData(GL_ARRAY_BUFFER, count * 4 * 5 * sizeof(GLfloat), vertices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, t->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * 6 * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+    GLsizei stride = 5 * sizeof(GLfloat);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+
+    free(vertices);
+    free(indices);
+}
+
+/* GL_RGBA8 with GL_BGRA/GL_UNSIGNED_INT_8_8_8_8_REV is byte for byte what X
+ * gives us for 32 bit visuals, so drivers can copy it without swizzling.
+ *
+ * Tiles that may get mipmaps later have mutable storage with only the first
+ * level, glGenerateMipmap allocates the others once they are wanted.
+ */
+static void
+allocate_tile(Texture *t, Tile *tile)
+{
+    GL(glGenTextures(1, &tile->id));
+    GL(glBindTexture(GL_TEXTURE_2D, tile->id));
+
+    if (GLEW_ARB_texture_storage && !t->mipmaps) {
+        GL(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, tile->width, tile->height));
+    } else {
+        GL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tile->width, tile->height, 0,
+            GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL));
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0));
+    }
+
+    /* Whatever hasn't been streamed in yet shows up black rather than as
+     * uninitialized memory.
+     */
+    if (GLEW_ARB_clear_texture) {
+        GLubyte black[BYTES_PER_PIXEL] = {0};
+        GL(glClearTexImage(tile->id, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, black));
+    }
+
+    /* Tiles butt against each other, clamping to the edge keeps the border
+     * color from bleeding into the seams.
+     */
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    apply_sampling(t, tile);
+}
+
+/* Set the filters of the bound tile */
+static void
+apply_sampling(Texture *t, Tile *tile)
+{
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+        sampling_min_filter(t->minify, tile->mipmapped)));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling_mag_filter(t->magnify)));
+
+    if (GLEW_EXT_texture_filter_anisotropic && tile->mipmapped) {
+        GLfloat max = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max);
+        GL(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+            CLAMP(1.0f, t->anisotropy, max)));
+    }
+}
+
+/* Build the mip chain of the bound tile, it has to be complete */
+static void
+build_tile_mipmaps(Texture *t, Tile *tile)
+{
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+        mip_levels(tile->width, tile->height) - 1));
+    GL(glGenerateMipmap(GL_TEXTURE_2D));
+    tile->mipmapped = true;
+    tile->filter_generation = 0;
+    apply_sampling(t, tile);
+}
+
+void
+texture_create(Texture *t, int width, int height, bool mipmaps)
+{
+    GLint max_size = 0;
+
+    memset(t, 0, sizeof(*t));
+    t->width   = width;
+    t->height  = height;
+    t->mipmaps = mipmaps;
+    t->minify  = MINIFY_NEAREST;
+    t->magnify = MAGNIFY_NEAREST;
+    t->anisotropy = 1.0f;
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    t->tile_size = MIN(MAX(max_size, 64), TEXTURE_MAX_TILE_SIZE);
+    t->cols = (width  + t->tile_size - 1) / t->tile_size;
+    t->rows = (height + t->tile_size - 1) / t->tile_size;
+
+    t->tiles = calloc(t->cols * t->rows, sizeof(Tile));
+    if (t->tiles == NULL)
+        die("Malloc failed to allocate:");
+
+    for (int row = 0; row < t->rows; row++) {
+        for (int col = 0; col < t->cols; col++) {
+            Tile *tile = &t->tiles[row * t->cols + col];
+
+            tile->x = col * t->tile_size;
+            tile->y = row * t->tile_size;
+            tile->width  = MIN(t->tile_size, width  - tile->x);
+            tile->height = MIN(t->tile_size, height - tile->y);
+        }
+    }
+
+    build_geometry(t);
+
+    t->pbo_size = MAX((size_t)BAND_BYTES, (size_t)t->tile_size * BYTES_PER_PIXEL);
+    glGenBuffers(TEXTURE_PBO_COUNT, t->pbo);
+    for (int i = 0; i < TEXTURE_PBO_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, t->pbo[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, t->pbo_size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/* Set the image tiles are streamed from and the layout of its pixels. The
+ * source must stay valid until the texture is complete, and is kept up to
+ * date by texture_upload_region.
+ */
+void
+texture_stream(Texture *t, void *data, size_t stride, const PixelFormat *format)
+{
+    t->src = data;
+    t->src_stride = stride;
+    t->format = *format;
+    t->complete = false;
+
+    for (int i = 0; i < t->cols * t->rows; i++) {
+        t->tiles[i].next_row = 0;
+        t->tiles[i].complete = false;
+    }
+}
+
+/* The unfinished visible tile closest to the focus point, usually the
+ * cursor.
+ */
+static Tile *
+next_tile(Texture *t, Vec2f view_min, Vec2f view_max, Vec2f focus)
+{
+    Tile *best = NULL;
+    float best_dist = 0.0f;
+
+    for (int i = 0; i < t->cols * t->rows; i++) {
+        Tile *tile = &t->tiles[i];
+        if (tile->complete || !tile_visible(tile, view_min, view_max))
+            continue;
+
+        Vec2f center = { tile->x + tile->width * 0.5f, tile->y + tile->height * 0.5f };
+        Vec2f d = SUB(center, focus);
+        float dist = d.x * d.x + d.y * d.y;
+
+        if (best == NULL || dist < best_dist) {
+            best = tile;
+            best_dist = dist;
+        }
+    }
+    return best;
+}
+
+/* Upload the next bands of the visible tiles, those nearest to `focus`
+ * first, at most `budget` bytes of them (0 means no limit). Tiles that are
+ * not in view are left alone. Returns the number of bytes uploaded.
+ */
+size_t
+texture_stream_step(Texture *t, size_t budget, Vec2f view_min, Vec2f view_max, Vec2f focus)
+{
+    size_t used = 0;
+    Tile *tile;
+
+    if (t->complete || t->src == NULL)
+        return 0;
+
+    while ((budget == 0 || used < budget)
+            && (tile = next_tile(t, view_min, view_max, focus)) != NULL) {
+        size_t row_bytes = (size_t)tile->width * BYTES_PER_PIXEL;
+        int rows = tile->height - tile->next_row;
+        if (budget > 0)
+            rows = CLAMP(1, (int)((budget - used) / row_bytes), rows);
+
+        if (tile->id == 0)
+            allocate_tile(t, tile);
+
+        int y = tile->y + tile->next_row;
+        upload_rect(t, tile, tile->x, y, tile->width, rows,
+            t->src + (size_t)y * t->src_stride + (size_t)tile->x * t->format.bytes_per_pixel,
+            t->src_stride);
+
+        tile->next_row += rows;
+        used += row_bytes * rows;
+
+        if (tile->next_row == tile->height) {
+            if (t->mipmapped)
+                build_tile_mipmaps(t, tile);
+            tile->complete = true;
+        }
+    }
+
+    t->complete = true;
+    for (int i = 0; i < t->cols * t->rows; i++)
+        t->complete &= t->tiles[i].complete;
+
+    return used;
+}
+
+/* Convert a rectangle of source pixels into a tile. The rows are written
+ * into alternating, orphaned PBOs so the CPU conversion of one band overlaps
+ * the driver's transfer of the previous one.
+ */
+static void
+upload_rect(Texture *t, Tile *tile, int x, int y, int width, int height,
+        const unsigned char *src, size_t stride)
+{
+    size_t row_bytes = (size_t)width * BYTES_PER_PIXEL;
+    int band_rows = MAX(1, (int)(t->pbo_size / row_bytes));
+
+    GL(glBindTexture(GL_TEXTURE_2D, tile->id));
+    invalidate_filtered(t, x, y, width, height);
+
+    for (int row = 0; row < height; row += band_rows) {
+        int rows = MIN(band_rows, height - row);
+        size_t bytes = row_bytes * rows;
+
+        GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, t->pbo[t->pbo_next]));
+        t->pbo_next = (t->pbo_next + 1) % TEXTURE_PBO_COUNT;
+
+        /* Orphan the previous storage so mapping never waits on the GPU */
+        GL(glBufferData(GL_PIXEL_UNPACK_BUFFER, t->pbo_size, NULL, GL_STREAM_DRAW));
+        unsigned char *dst = GL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (dst == NULL)
+            break;
+
+        convert_rows(&t->format, dst, row_bytes, src + (size_t)row * stride, stride, width, rows);
+        GL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+        GL(glTexSubImage2D(GL_TEXTURE_2D, 0, x - tile->x, y - tile->y + row, width, rows,
+            GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL));
+    }
+    GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+    stats.upload_bytes += row_bytes * height;
+}
+
+/* Replace a rectangle of the image, given in the layout the texture is
+ * streamed from. The streaming source is updated as well, tiles only receive
+ * the rows they already hold; the rest arrives when they are streamed.
+ * Returns the number of bytes sent to the GPU.
+ */
+size_t
+texture_upload_region(Texture *t, int x, int y, int width, int height,
+        const void *data, size_t stride)
+{
+    const unsigned char *src = data;
+    size_t pixel = t->format.bytes_per_pixel;
+    size_t uploaded = 0;
+
+    if (t->src != NULL) {
+        for (int i = 0; i < height; i++) {
+            memcpy(t->src + (size_t)(y + i) * t->src_stride + (size_t)x * pixel,
+                src + (size_t)i * stride, (size_t)width * pixel);
+        }
+    }
+
+    for (int i = 0; i < t->cols * t->rows; i++) {
+        Tile *tile = &t->tiles[i];
+        if (tile->id == 0)
+            continue;
+
+        int x0 = MAX(x, tile->x);
+        int y0 = MAX(y, tile->y);
+        int x1 = MIN(x + width,  tile->x + tile->width);
+        int y1 = MIN(y + height, tile->y + tile->next_row);
+        if (x0 >= x1 || y0 >= y1)
+            continue;
+
+        upload_rect(t, tile, x0, y0, x1 - x0, y1 - y0,
+            src + (size_t)(y0 - y) * stride + (size_t)(x0 - x) * pixel, stride);
+        if (tile->mipmapped)
+            GL(glGenerateMipmap(GL_TEXTURE_2D));
+        uploaded += (size_t)(x1 - x0) * (y1 - y0) * BYTES_PER_PIXEL;
+    }
+    return uploaded;
+}
+
+/* Draw every resident tile that intersects the visible part of the image */
+void
+texture_draw(Texture *t, Vec2f view_min, Vec2f view_max)
+{
+    GL(glBindVertexArray(t->vao));
+    for (int i = 0; i < t->cols * t->rows; i++) {
+        Tile *tile = &t->tiles[i];
+        if (tile->id == 0 || !tile_visible(tile, view_min, view_max))
+            continue;
+
+        GL(glBindTexture(GL_TEXTURE_2D, tile->filtered ? tile->filtered : tile->id));
+        GL(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void *)(i * 6 * sizeof(GLuint))));
+    }
+    GL(glBindVertexArray(0));
+}
+
+/* Change how the tiles are sampled, tiles allocated later follow suit */
+void
+texture_set_sampling(Texture *t, Minify minify, Magnify magnify, float anisotropy)
+{
+    t->minify = minify;
+    t->magnify = magnify;
+    t->anisotropy = anisotropy;
+
+    for (int i = 0; t->tiles && i < t->cols * t->rows; i++) {
+        if (t->tiles[i].id == 0)
+            continue;
+        GL(glBindTexture(GL_TEXTURE_2D, t->tiles[i].id));
+        apply_sampling(t, &t->tiles[i]);
+        if (t->tiles[i].filtered) {
+            GL(glBindTexture(GL_TEXTURE_2D, t->tiles[i].filtered));
+            apply_sampling(t, &t->tiles[i]);
+        }
+    }
+}
+
+/* Build the mip chains the first time they are needed. Tiles that are still
+ * being streamed get theirs once they are complete.
+ */
+void
+texture_build_mipmaps(Texture *t)
+{
+    if (!t->mipmaps || t->mipmapped)
+        return;
+
+    t->mipmapped = true;
+    for (int i = 0; t->tiles && i < t->cols * t->rows; i++) {
+        Tile *tile = &t->tiles[i];
+        if (tile->id == 0 || !tile->complete)
+            continue;
+        GL(glBindTexture(GL_TEXTURE_2D, tile->id));
+        build_tile_mipmaps(t, tile);
+    }
+}
+
+/* Mark the filtered copies that read a rectangle of the image as stale,
+ * the tiles under it and those whose apron reaches into it
+ */
+static void
+invalidate_filtered(Texture *t, int x, int y, int width, int height)
+{
+    int reach = FILTER_MAX * FILTER_RADIUS;
+    int c0 = MAX(0, x - reach) / t->tile_size;
+    int r0 = MAX(0, y - reach) / t->tile_size;
+    int c1 = MIN(t->width - 1, x + width - 1 + reach) / t->tile_size;
+    int r1 = MIN(t->height - 1, y + height - 1 + reach) / t->tile_size;
+
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++)
+            t->tiles[r * t->cols + c].filter_generation = 0;
+    }
+}
+
+/* Copy the rectangle x0, y0 to x1, y1 of the image from the tiles holding
+ * it into the apron texture. Parts of tiles not uploaded yet are left
+ * black, the tile is filtered again once they arrive.
+ */
+static void
+gather_apron(Texture *t, int x0, int y0, int x1, int y1)
+{
+    static const GLfloat black[] = {0.0f, 0.0f, 0.0f, 1.0f};
+    int size = t->tile_size + 2 * FILTER_MAX * FILTER_RADIUS;
+
+    if (t->apron == 0) {
+        glGenTextures(1, &t->apron);
+        glBindTexture(GL_TEXTURE_2D, t->apron);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size, size);
+        glGenFramebuffers(1, &t->apron_fbo);
+        t->apron_size = size;
+    }
+
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, t->apron_fbo));
+    GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t->apron, 0));
+    GL(glClearBufferfv(GL_COLOR, 0, black));
+    GL(glBindTexture(GL_TEXTURE_2D, t->apron));
+
+    for (int r = y0 / t->tile_size; r <= (y1 - 1) / t->tile_size; r++) {
+        for (int c = x0 / t->tile_size; c <= (x1 - 1) / t->tile_size; c++) {
+            Tile *n = &t->tiles[r * t->cols + c];
+            int nx = MAX(x0, n->x), ny = MAX(y0, n->y);
+            int height = MIN(y1, n->y + n->next_row) - ny;
+
+            if (n->id == 0 || height <= 0)
+                continue;
+            GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, n->id, 0));
+            GL(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, nx - x0, ny - y0, nx - n->x, ny - n->y,
+                MIN(x1, n->x + n->width) - nx, height));
+        }
+    }
+    GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+/* Bring the filtered copies of the visible tiles up to date, running the
+ * graph only over tiles that changed since they were last filtered. Without
+ * filters the copies are dropped and the tiles are drawn as they are.
+ */
+void
+texture_filter(Texture *t, FilterGraph *g, Vec2f view_min, Vec2f view_max)
+{
+    for (int i = 0; t->tiles && i < t->cols * t->rows; i++) {
+        Tile *tile = &t->tiles[i];
+
+        if (g->count == 0) {
+            if (tile->filtered)
+                glDeleteTextures(1, &tile->filtered);
+            tile->filtered = 0;
+            continue;
+        }
+        if (tile->id == 0 || tile->filter_generation == g->generation
+            || !tile_visible(tile, view_min, view_max))
+            continue;
+
+        /* Neighbourhood filters read past the tile, give them the texels
+         * of its neighbours there, and clamp only at the image's edges
+         */
+        int apron = filter_graph_apron(g);
+        int x0 = MAX(0, tile->x - apron), y0 = MAX(0, tile->y - apron);
+        int x1 = MIN(t->width, tile->x + tile->width + apron);
+        int y1 = MIN(t->height, tile->y + tile->height + apron);
+
+        if (x0 == tile->x && y0 == tile->y && x1 - x0 == tile->width && y1 - y0 == tile->height) {
+            filter_graph_apply(g, tile->id, tile->width, tile->height, &tile->filtered);
+        } else {
+            gather_apron(t, x0, y0, x1, y1);
+            filter_graph_apply_region(g, t->apron, x1 - x0, y1 - y0, tile->x - x0, tile->y - y0,
+                tile->width, tile->height, &tile->filtered);
+        }
+        tile->filter_generation = g->generation;
+
+        GL(glBindTexture(GL_TEXTURE_2D, tile->filtered));
+        if (tile->mipmapped) {
+            GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                mip_levels(tile->width, tile->height) - 1));
+            GL(glGenerateMipmap(GL_TEXTURE_2D));
+        }
+        apply_sampling(t, tile);
+    }
+}
+
+/* Forget the streaming source once every tile holds its pixels, so it can
+ * be freed.
+ */
+void
+texture_release_source(Texture *t)
+{
+    t->src = NULL;
+    t->src_stride = 0;
+}
+
+/* Estimated GPU memory held by the texture: allocated tiles and their
+ * filtered copies, a third more for their mipmaps, and the upload buffers.
+ */
+size_t
+texture_bytes(const Texture *t)
+{
+    size_t bytes = 0;
+
+    for (int i = 0; t->tiles && i < t->cols * t->rows; i++) {
+        size_t tile_bytes = (size_t)t->tiles[i].width * t->tiles[i].height * BYTES_PER_PIXEL;
+        if (t->tiles[i].id)
+            bytes += tile_bytes;
+        if (t->tiles[i].filtered)
+            bytes += tile_bytes;
+    }
+    if (t->mipmapped)
+        bytes += bytes / 3;
+    if (t->apron)
+        bytes += (size_t)t->apron_size * t->apron_size * BYTES_PER_PIXEL;
+    if (t->pbo[0])
+        bytes += t->pbo_size * TEXTURE_PBO_COUNT;
+    return bytes;
+}
+
+void
+texture_destroy(Texture *t)
+{
+    for (int i = 0; t->tiles && i < t->cols * t->rows; i++) {
+        if (t->tiles[i].id)
+            glDeleteTextures(1, &t->tiles[i].id);
+        if (t->tiles[i].filtered)
+            glDeleteTextures(1, &t->tiles[i].filtered);
+    }
+    free(t->tiles);
+
+    if (t->apron) {
+        glDeleteTextures(1, &t->apron);
+        glDeleteFramebuffers(1, &t->apron_fbo);
+    }
+    if (t->pbo[0])
+        glDeleteBuffers(TEXTURE_PBO_COUNT, t->pbo);
+    if (t->vao) {
+        glDeleteVertexArrays(1, &t->vao);
+        glDeleteBuffers(1, &t->vbo);
+        glDeleteBuffers(1, &t->ebo);
+    }
+
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,98 @@
+#ifndef ZOOC_TEXTURE_H
+#define ZOOC_TEXTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <GL/gl.h>
+
+#include "convert.h"
+#include "filter.h"
+#include "sampling.h"
+#include "vec.h"
+
+#define TEXTURE_PBO_COUNT 2
+
+/* Upper bound for tiles, smaller tiles let the area around the cursor
+ * arrive first even when the whole screen would fit in one texture.
+ */
+#define TEXTURE_MAX_TILE_SIZE 2048
+
+/* A piece of the screenshot small enough to fit in a single GL texture. Its
+ * storage is only allocated once it is first seen.
+ */
+typedef struct {
+    GLuint id;
+    int x;
+    int y;
+    int width;
+    int height;
+    int next_row;
+    bool complete;
+    bool mipmapped;
+
+    /* The tile run through the filter graph, drawn instead when there is
+     * one. It is stale unless made by the graph's current generation.
+     */
+    GLuint filtered;
+    unsigned int filter_generation;
+} Tile;
+
+/* Screenshot texture, split into a grid of tiles with immutable BGRA
+ * storage. Pixels are converted from the captured XImage's layout straight
+ * into a pair of pixel buffer objects, so the driver copies them
+ * asynchronously while the next band is being filled.
+ */
+typedef struct {
+    int width;
+    int height;
+
+    /* The mip chain is only built once the image is first shown zoomed
+     * out, see texture_build_mipmaps.
+     */
+    bool mipmaps;
+    bool mipmapped;
+    Minify minify;
+    Magnify magnify;
+    float anisotropy;
+
+    int tile_size;
+    int cols;
+    int rows;
+    Tile *tiles;
+
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+
+    /* A tile with a border from its neighbours, filtered in its place so
+     * no seams show between filtered tiles
+     */
+    GLuint apron;
+    int apron_size;
+    GLuint apron_fbo;
+
+    GLuint pbo[TEXTURE_PBO_COUNT];
+    size_t pbo_size;
+    int pbo_next;
+
+    /* Pixels of the whole image, tiles are streamed from here */
+    unsigned char *src;
+    size_t src_stride;
+    PixelFormat format;
+    bool complete;
+} Texture;
+
+void texture_create(Texture *, int, int, bool);
+void texture_stream(Texture *, void *, size_t, const PixelFormat *);
+size_t texture_stream_step(Texture *, size_t, Vec2f, Vec2f, Vec2f);
+size_t texture_upload_region(Texture *, int, int, int, int, const void *, size_t);
+void texture_draw(Texture *, Vec2f, Vec2f);
+void texture_set_sampling(Texture *, Minify, Magnify, float);
+void texture_build_mipmaps(Texture *);
+void texture_filter(Texture *, FilterGraph *, Vec2f, Vec2f);
+void texture_release_source(Texture *);
+size_t texture_bytes(const Texture *);
+void texture_destroy(Texture *);
+
+#endif
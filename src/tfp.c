@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+#include "stats.h"
+#include "tfp.h"
+#include "util.h"
+
+static bool choose_fbconfig(Display *, int, int, GLXFBConfig *, bool *);
+
+static PFNGLXBINDTEXIMAGEEXTPROC bind_tex_image = NULL;
+static PFNGLXRELEASETEXIMAGEEXTPROC release_tex_image = NULL;
+
+bool
+tfp_supported(Display *dpy, int screen)
+{
+    if (!has_extension(glXQueryExtensionsString(dpy, screen), "GLX_EXT_texture_from_pixmap"))
+        return false;
+
+    bind_tex_image = (PFNGLXBINDTEXIMAGEEXTPROC)
+        glXGetProcAddressARB((const GLubyte *)"glXBindTexImageEXT");
+    release_tex_image = (PFNGLXRELEASETEXIMAGEEXTPROC)
+        glXGetProcAddressARB((const GLubyte *)"glXReleaseTexImageEXT");
+
+    return bind_tex_image != NULL && release_tex_image != NULL;
+}
+
+/* Pick a pixmap-capable config that can be bound as an RGB 2D texture and
+ * whose visual depth matches the pixmap we are going to create.
+ */
+static bool
+choose_fbconfig(Display *dpy, int screen, int depth, GLXFBConfig *out, bool *y_inverted)
+{
+    int attrs[] = {
+        GLX_DRAWABLE_TYPE, GLX_PIXMAP_BIT,
+        GLX_BIND_TO_TEXTURE_RGB_EXT, True,
+        GLX_BIND_TO_TEXTURE_TARGETS_EXT, GLX_TEXTURE_2D_BIT_EXT,
+        GLX_DOUBLEBUFFER, False,
+        GLX_Y_INVERTED_EXT, (int)GLX_DONT_CARE,
+        None
+    };
+    int count = 0;
+    bool found = false;
+
+    GLXFBConfig *configs = glXChooseFBConfig(dpy, screen, attrs, &count);
+    if (configs == NULL)
+        return false;
+
+    for (int i = 0; i < count && !found; i++) {
+        XVisualInfo *vi = glXGetVisualFromFBConfig(dpy, configs[i]);
+        if (vi == NULL)
+            continue;
+
+        if (vi->depth == depth) {
+            int inverted = 0;
+            glXGetFBConfigAttrib(dpy, configs[i], GLX_Y_INVERTED_EXT, &inverted);
+
+            *out = configs[i];
+            *y_inverted = inverted == True;
+            found = true;
+        }
+        XFree(vi);
+    }
+
+    XFree(configs);
+    return found;
+}
+
+/* The root window can not be named with XCompositeNameWindowPixmap as it is
+ * never redirected, so its contents are copied into a pixmap on the server
+ * instead. The pixels never leave the X server: the pixmap is bound straight
+ * into a GL texture.
+ */
+bool
+tfp_create(Display *dpy, int screen, Drawable src, int src_x, int src_y,
+        unsigned int width, unsigned int height, PixmapTexture *pt)
+{
+    XWindowAttributes attrs;
+    GLXFBConfig fbconfig;
+    GLint max_size = 0;
+
+    memset(pt, 0, sizeof(*pt));
+
+    /* A pixmap is bound as one texture, it can't be split into tiles */
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if ((GLint)MAX(width, height) > max_size)
+        return false;
+
+    if (!tfp_supported(dpy, screen) || !XGetWindowAttributes(dpy, src, &attrs))
+        return false;
+
+    if (!choose_fbconfig(dpy, screen, attrs.depth, &fbconfig, &pt->y_inverted))
+        return false;
+
+    pt->width  = width;
+    pt->height = height;
+    pt->src    = src;
+    pt->src_x  = src_x;
+    pt->src_y  = src_y;
+    pt->pixmap = XCreatePixmap(dpy, src, width, height, attrs.depth);
+
+    XGCValues gcv = { .subwindow_mode = IncludeInferiors };
+    pt->gc = XCreateGC(dpy, pt->pixmap, GCSubwindowMode, &gcv);
+
+    int pixmap_attrs[] = {
+        GLX_TEXTURE_TARGET_EXT, GLX_TEXTURE_2D_EXT,
+        GLX_TEXTURE_FORMAT_EXT, GLX_TEXTURE_FORMAT_RGB_EXT,
+        None
+    };
+    pt->glx_pixmap = glXCreatePixmap(dpy, fbconfig, pt->pixmap, pixmap_attrs);
+    if (pt->glx_pixmap == None) {
+        tfp_destroy(dpy, pt);
+        return false;
+    }
+
+    glGenTextures(1, &pt->texture);
+    glBindTexture(GL_TEXTURE_2D, pt->texture);
+
+    tfp_refresh(dpy, pt);
+    return true;
+}
+
+/* Copy the source into the pixmap again and rebind it, so the texture picks
+ * up the new contents.
+ */
+void
+tfp_refresh(Display *dpy, PixmapTexture *pt)
+{
+    XRectangle all = { 0, 0, pt->width, pt->height };
+
+    tfp_update(dpy, pt, &all, 1);
+}
+
+/* Like tfp_refresh, but only copies the given rectangles, in pixmap
+ * coordinates.
+ */
+void
+tfp_update(Display *dpy, PixmapTexture *pt, const XRectangle *rects, int count)
+{
+    if (pt->bound)
+        GL(release_tex_image(dpy, pt->glx_pixmap, GLX_FRONT_LEFT_EXT));
+
+    for (int i = 0; i < count; i++) {
+        XCopyArea(dpy, pt->src, pt->pixmap, pt->gc,
+            pt->src_x + rects[i].x, pt->src_y + rects[i].y,
+            rects[i].width, rects[i].height,
+            rects[i].x, rects[i].y);
+    }
+    GL(glXWaitX());
+
+    GL(glBindTexture(GL_TEXTURE_2D, pt->texture));
+    GL(bind_tex_image(dpy, pt->glx_pixmap, GLX_FRONT_LEFT_EXT, NULL));
+    pt->bound = true;
+}
+
+void
+tfp_destroy(Display *dpy, PixmapTexture *pt)
+{
+    if (pt->bound)
+        release_tex_image(dpy, pt->glx_pixmap, GLX_FRONT_LEFT_EXT);
+    if (pt->texture)
+        glDeleteTextures(1, &pt->texture);
+    if (pt->glx_pixmap != None)
+        glXDestroyPixmap(dpy, pt->glx_pixmap);
+    if (pt->gc)
+        XFreeGC(dpy, pt->gc);
+    if (pt->pixmap != None)
+        XFreePixmap(dpy, pt->pixmap);
+
+    memset(pt, 0, sizeof(*pt));
+}
@@ -0,0 +1,34 @@
+#ifndef ZOOC_TFP_H
+#define ZOOC_TFP_H
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+/* Screen contents held in a server side pixmap and bound as a GL texture
+ * through GLX_EXT_texture_from_pixmap.
+ */
+typedef struct {
+    Drawable src;
+    int src_x;
+    int src_y;
+    Pixmap pixmap;
+    GLXPixmap glx_pixmap;
+    GC gc;
+    GLuint texture;
+    unsigned int width;
+    unsigned int height;
+    bool y_inverted;
+    bool bound;
+} PixmapTexture;
+
+bool tfp_supported(Display *, int);
+bool tfp_create(Display *, int, Drawable, int, int, unsigned int, unsigned int, PixmapTexture *);
+void tfp_refresh(Display *, PixmapTexture *);
+void tfp_update(Display *, PixmapTexture *, const XRectangle *, int);
+void tfp_destroy(Display *, PixmapTexture *);
+
+#endif
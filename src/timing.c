@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.h"
+#include "util.h"
+
+Timings timings;
+
+static const char *stage_names[STAGE_COUNT] = {
+    [STAGE_CONFIG]      = "config",
+    [STAGE_DISPLAY]     = "display",
+    [STAGE_CAPTURE]     = "capture",
+    [STAGE_WINDOW]      = "window",
+    [STAGE_CONTEXT]     = "context",
+    [STAGE_SHADERS]     = "shaders",
+    [STAGE_JOIN]        = "wait for capture",
+    [STAGE_UPLOAD]      = "upload",
+    [STAGE_FIRST_FRAME] = "first frame",
+};
+
+void
+timing_init(bool enabled)
+{
+    memset(&timings, 0, sizeof(timings));
+    timings.enabled = enabled;
+    timings.start = now_ns();
+}
+
+void
+timing_begin(Stage stage)
+{
+    timings.begin[stage] = now_ns() - timings.start;
+}
+
+void
+timing_end(Stage stage)
+{
+    timings.end[stage] = now_ns() - timings.start;
+}
+
+/* Print when every stage ran and how long it took, then the time until the
+ * first frame was on its way to the screen.
+ */
+void
+timing_report(void)
+{
+    if (!timings.enabled)
+        return;
+
+    fprintf(stderr, "%-18s %10s %10s\n", "stage", "start ms", "took ms");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (timings.end[i] == 0)
+            continue;
+        fprintf(stderr, "%-18s %10.2f %10.2f\n", stage_names[i],
+            timings.begin[i] / 1e6, (timings.end[i] - timings.begin[i]) / 1e6);
+    }
+    fprintf(stderr, "time to first frame: %.2f ms\n", timings.end[STAGE_FIRST_FRAME] / 1e6);
+
+    timings.enabled = false;
+}
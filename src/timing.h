@@ -0,0 +1,40 @@
+#ifndef ZOOC_TIMING_H
+#define ZOOC_TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Startup stages, in the order they are reported. Capture runs on its own
+ * thread alongside window, context and shader creation.
+ */
+typedef enum {
+    STAGE_CONFIG,
+    STAGE_DISPLAY,
+    STAGE_CAPTURE,
+    STAGE_WINDOW,
+    STAGE_CONTEXT,
+    STAGE_SHADERS,
+    STAGE_JOIN,
+    STAGE_UPLOAD,
+    STAGE_FIRST_FRAME,
+    STAGE_COUNT,
+} Stage;
+
+/* Begin and end of every stage, in nanoseconds since `start`. Each stage is
+ * only ever written by the thread running it.
+ */
+typedef struct {
+    bool enabled;
+    uint64_t start;
+    uint64_t begin[STAGE_COUNT];
+    uint64_t end[STAGE_COUNT];
+} Timings;
+
+extern Timings timings;
+
+void timing_init(bool);
+void timing_begin(Stage);
+void timing_end(Stage);
+void timing_report(void);
+
+#endif
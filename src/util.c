@@ -1,8 +1,10 @@
+#include <stdbool.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "util.h"
 
@@ -24,3 +26,28 @@ die(const char *fmt, ...)
 
     exit(EXIT_FAILURE);
 }
+
+/* Monotonic timestamp in nanoseconds, for measuring intervals only. */
+uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Extension strings are space separated, so a plain strstr could match a
+ * prefix of a longer name.
+ */
+bool
+has_extension(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+
+    for (const char *p = list; p && (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+            return true;
+    }
+    return false;
+}
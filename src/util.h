@@ -1,6 +1,9 @@
 #ifndef ZOOC_UTIL_H
 #define ZOOC_UTIL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #define UNUSED(e)        do { (void)(e); } while (0)
 #define MAX(A, B)        (((A) > (B)) ? (A) : (B))
 #define MIN(A, B)        (((A) < (B)) ? (A) : (B))
@@ -10,5 +13,7 @@
 #define CLAMP(A, X, B)   (((X) < (A)) ? (A) : ((B) < (X)) ? (B) : (X))
 
 void die(const char *fmt, ...);
+bool has_extension(const char *, const char *);
+uint64_t now_ns(void);
 
 #endif
@@ -0,0 +1,398 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "image.h"
+#include "sampling.h"
+#include "stats.h"
+#include "util.h"
+#include "vec.h"
+#include "viewer.h"
+
+#define BYTES_PER_PIXEL     4
+#define TILE_BYTES          ((size_t)VIEWER_TILE_SIZE * VIEWER_TILE_SIZE * BYTES_PER_PIXEL)
+
+static int level_for(const Viewer *, float);
+static bool visible_range(const Viewer *, int, Vec2f, Vec2f, int *, int *, int *, int *);
+static void apply_sampling(Viewer *);
+static int take_slot(Viewer *);
+static bool load_tile(Viewer *, int, int, int);
+static void pad_tile(unsigned char *, int, int);
+
+/* The level whose pixels come closest to the size of a screen pixel */
+static int
+level_for(const Viewer *v, float scale)
+{
+    int level = scale < 1.0f ? (int)floorf(log2f(1.0f / scale) + 0.5f) : 0;
+
+    return MIN(level, v->level_count - 1);
+}
+
+/* The tiles of `level` that intersect the view, false when none do */
+static bool
+visible_range(const Viewer *v, int level, Vec2f min, Vec2f max,
+        int *col0, int *row0, int *col1, int *row1)
+{
+    const ViewerLevel *l = &v->levels[level];
+    float span = ldexpf(VIEWER_TILE_SIZE, level);
+
+    if (max.x <= 0.0f || max.y <= 0.0f
+        || min.x >= v->image->width || min.y >= v->image->height)
+        return false;
+
+    *col0 = MAX(0, (int)floorf(min.x / span));
+    *row0 = MAX(0, (int)floorf(min.y / span));
+    *col1 = MIN(l->cols - 1, (int)floorf(max.x / span));
+    *row1 = MIN(l->rows - 1, (int)floorf(max.y / span));
+    return true;
+}
+
+/* Set the filters of the bound slot. Every level is a mip level of its own,
+ * so slots have no mip chain.
+ */
+static void
+apply_sampling(Viewer *v)
+{
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampling_min_filter(v->minify, false)));
+    GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling_mag_filter(v->magnify)));
+}
+
+/* A slot for a new tile: a fresh one while under the limit, otherwise the
+ * least recently drawn one that wasn't needed this frame. The top level is
+ * never given up. Returns -1 when every slot is in view.
+ */
+static int
+take_slot(Viewer *v)
+{
+    if (v->slot_count < v->slot_limit) {
+        ViewerSlot *slot = &v->slots[v->slot_count];
+
+        GL(glGenTextures(1, &slot->id));
+        GL(glBindTexture(GL_TEXTURE_2D, slot->id));
+        if (GLEW_ARB_texture_storage) {
+            GL(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, VIEWER_TILE_SIZE, VIEWER_TILE_SIZE));
+        } else {
+            GL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, VIEWER_TILE_SIZE, VIEWER_TILE_SIZE, 0,
+                GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL));
+            GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0));
+        }
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        apply_sampling(v);
+        return v->slot_count++;
+    }
+
+    int best = -1;
+    for (int i = 0; i < v->slot_count; i++) {
+        ViewerSlot *slot = &v->slots[i];
+        if (slot->used == v->frame || slot->level == v->level_count - 1)
+            continue;
+        if (best == -1 || slot->used < v->slots[best].used)
+            best = i;
+    }
+    if (best != -1) {
+        ViewerSlot *slot = &v->slots[best];
+        ViewerLevel *l = &v->levels[slot->level];
+        l->slots[slot->row * l->cols + slot->col] = -1;
+    }
+    return best;
+}
+
+/* Repeat the last column and row of a tile at the edge of the image over
+ * the rest of it, so linear filtering doesn't pick up a previous tile.
+ */
+static void
+pad_tile(unsigned char *pixels, int width, int height)
+{
+    size_t stride = (size_t)VIEWER_TILE_SIZE * BYTES_PER_PIXEL;
+
+    for (int y = 0; y < height && width < VIEWER_TILE_SIZE; y++) {
+        unsigned char *row = pixels + y * stride;
+        for (int x = width; x < VIEWER_TILE_SIZE; x++)
+            memcpy(row + x * BYTES_PER_PIXEL, row + (width - 1) * BYTES_PER_PIXEL, BYTES_PER_PIXEL);
+    }
+    for (int y = height; y < VIEWER_TILE_SIZE; y++)
+        memcpy(pixels + y * stride, pixels + (height - 1) * stride, stride);
+}
+
+/* Convert a tile straight into an orphaned PBO and upload it from there */
+static bool
+load_tile(Viewer *v, int level, int col, int row)
+{
+    ViewerLevel *l = &v->levels[level];
+    int s = take_slot(v);
+    if (s == -1)
+        return false;
+
+    ViewerSlot *slot = &v->slots[s];
+    int x = col * VIEWER_TILE_SIZE;
+    int y = row * VIEWER_TILE_SIZE;
+
+    GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, v->pbo));
+    GL(glBufferData(GL_PIXEL_UNPACK_BUFFER, TILE_BYTES, NULL, GL_STREAM_DRAW));
+    unsigned char *dst = GL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, TILE_BYTES,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (dst != NULL) {
+        int width = MIN(VIEWER_TILE_SIZE, l->width - x);
+        int height = MIN(VIEWER_TILE_SIZE, l->height - y);
+
+        image_read(v->image, level, x, y, width, height, dst,
+            (size_t)VIEWER_TILE_SIZE * BYTES_PER_PIXEL);
+        pad_tile(dst, width, height);
+        GL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+        GL(glBindTexture(GL_TEXTURE_2D, slot->id));
+        GL(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VIEWER_TILE_SIZE, VIEWER_TILE_SIZE,
+            GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL));
+    }
+    GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+    slot->level = level;
+    slot->col = col;
+    slot->row = row;
+    slot->used = v->frame;
+    l->slots[row * l->cols + col] = s;
+
+    stats.upload_bytes += TILE_BYTES;
+    return true;
+}
+
+/* Build the pyramid of `img` with at most `limit` bytes of tiles. The limit
+ * is raised when it can't cover a window of `window_size`.
+ */
+void
+viewer_create(Viewer *v, const Image *img, size_t limit, Vec2f window_size)
+{
+    memset(v, 0, sizeof(*v));
+    v->image = img;
+    v->minify = MINIFY_NEAREST;
+    v->magnify = MAGNIFY_NEAREST;
+
+    /* Halve until the whole image fits in a single tile */
+    for (int level = 0; level < VIEWER_LEVEL_MAX; level++) {
+        ViewerLevel *l = &v->levels[level];
+        long step = 1L << level;
+
+        l->width  = (img->width  + step - 1) >> level;
+        l->height = (img->height + step - 1) >> level;
+        l->cols = (l->width  + VIEWER_TILE_SIZE - 1) / VIEWER_TILE_SIZE;
+        l->rows = (l->height + VIEWER_TILE_SIZE - 1) / VIEWER_TILE_SIZE;
+
+        l->slots = malloc((size_t)l->cols * l->rows * sizeof(int));
+        if (l->slots == NULL)
+            die("Malloc failed to allocate:");
+        for (int i = 0; i < l->cols * l->rows; i++)
+            l->slots[i] = -1;
+
+        v->level_count = level + 1;
+        if (l->cols == 1 && l->rows == 1)
+            break;
+    }
+
+    /* A level is drawn at up to sqrt(2) texels per pixel, and a tile may
+     * stick out on either side.
+     */
+    int cols = ceilf(window_size.x * (float)M_SQRT2 / VIEWER_TILE_SIZE) + 1;
+    int rows = ceilf(window_size.y * (float)M_SQRT2 / VIEWER_TILE_SIZE) + 1;
+    int needed = cols * rows + 1;
+
+    v->slot_limit = limit / TILE_BYTES;
+    if (v->slot_limit < needed) {
+        fprintf(stderr, "vram_limit is too small for the window, using %zu MiB\n",
+            (needed * TILE_BYTES) >> 20);
+        v->slot_limit = needed;
+    }
+    v->slots = calloc(v->slot_limit, sizeof(ViewerSlot));
+    if (v->slots == NULL)
+        die("Malloc failed to allocate:");
+
+    GL(glGenBuffers(1, &v->pbo));
+    GL(glGenVertexArrays(1, &v->vao));
+    GL(glGenBuffers(1, &v->vbo));
+
+    GL(glBindVertexArray(v->vao));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, v->vbo));
+    GLsizei stride = 5 * sizeof(GLfloat);
+    GL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0));
+    GL(glEnableVertexAttribArray(0));
+    GL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(GLfloat))));
+    GL(glEnableVertexAttribArray(1));
+    GL(glBindVertexArray(0));
+}
+
+void
+viewer_set_sampling(Viewer *v, Minify minify, Magnify magnify)
+{
+    v->minify = minify;
+    v->magnify = magnify;
+
+    for (int i = 0; i < v->slot_count; i++) {
+        GL(glBindTexture(GL_TEXTURE_2D, v->slots[i].id));
+        apply_sampling(v);
+    }
+}
+
+/* Stream in the tiles missing from the view at `scale`, given in image
+ * pixels, closest to `focus` first, while under `budget` bytes (0 means no
+ * limit). Returns the number of bytes uploaded, zero once nothing is missing
+ * or every slot is in view.
+ */
+size_t
+viewer_update(Viewer *v, float scale, Vec2f view_min, Vec2f view_max, Vec2f focus, size_t budget)
+{
+    int top = v->level_count - 1;
+    int col0, row0, col1, row1;
+    size_t uploaded = 0;
+
+    v->frame++;
+    v->shown = level_for(v, scale);
+
+    /* The top level stands in for whatever hasn't arrived yet */
+    if (v->levels[top].slots[0] == -1 && load_tile(v, top, 0, 0))
+        uploaded += TILE_BYTES;
+
+    if (!visible_range(v, v->shown, view_min, view_max, &col0, &row0, &col1, &row1))
+        return uploaded;
+
+    /* Claim what is already there before anything is evicted */
+    ViewerLevel *l = &v->levels[v->shown];
+    for (int row = row0; row <= row1; row++) {
+        for (int col = col0; col <= col1; col++) {
+            int s = l->slots[row * l->cols + col];
+            if (s != -1)
+                v->slots[s].used = v->frame;
+        }
+    }
+
+    float span = ldexpf(VIEWER_TILE_SIZE, v->shown);
+    while (budget == 0 || uploaded < budget) {
+        int best_col = -1, best_row = -1;
+        float best_dist = 0.0f;
+
+        for (int row = row0; row <= row1; row++) {
+            for (int col = col0; col <= col1; col++) {
+                if (l->slots[row * l->cols + col] != -1)
+                    continue;
+
+                Vec2f center = { (col + 0.5f) * span, (row + 0.5f) * span };
+                float dist = LEN(SUB(center, focus));
+                if (best_col == -1 || dist < best_dist) {
+                    best_col = col;
+                    best_row = row;
+                    best_dist = dist;
+                }
+            }
+        }
+        if (best_col == -1 || !load_tile(v, v->shown, best_col, best_row))
+            break;
+        uploaded += TILE_BYTES;
+    }
+    return uploaded;
+}
+
+/* Draw the tiles in view at the level picked by viewer_update. A tile that
+ * isn't there is drawn from the part of the closest coarser one that is.
+ */
+void
+viewer_draw(Viewer *v, Vec2f view_min, Vec2f view_max)
+{
+    int top = v->level_count - 1;
+    int col0, row0, col1, row1;
+    int count = 0;
+
+    if (!visible_range(v, v->shown, view_min, view_max, &col0, &row0, &col1, &row1))
+        return;
+
+    int quads = (col1 - col0 + 1) * (row1 - row0 + 1);
+    if (quads > v->quad_capacity) {
+        GLfloat *vertices = realloc(v->vertices, quads * 4 * 5 * sizeof(GLfloat));
+        GLuint *textures = realloc(v->textures, quads * sizeof(GLuint));
+        if (vertices == NULL || textures == NULL)
+            die("Malloc failed to allocate:");
+        v->vertices = vertices;
+        v->textures = textures;
+        v->quad_capacity = quads;
+    }
+
+    float width = v->image->width, height = v->image->height;
+    float span = ldexpf(VIEWER_TILE_SIZE, v->shown);
+
+    for (int row = row0; row <= row1; row++) {
+        for (int col = col0; col <= col1; col++) {
+            int level = v->shown, c = col, r = row, s;
+
+            while ((s = v->levels[level].slots[r * v->levels[level].cols + c]) == -1
+                    && level < top) {
+                level++;
+                c >>= 1;
+                r >>= 1;
+            }
+            if (s == -1)
+                continue;
+            v->slots[s].used = v->frame;
+
+            /* The area of the tile in image pixels, and where that lies in
+             * the texture drawn for it. Image row r sits at y = height - r.
+             */
+            float x0 = col * span, x1 = MIN((col + 1) * span, width);
+            float y0 = row * span, y1 = MIN((row + 1) * span, height);
+            float texel = ldexpf(1.0f, level);
+            float u0 = (x0 / texel - c * VIEWER_TILE_SIZE) / VIEWER_TILE_SIZE;
+            float u1 = (x1 / texel - c * VIEWER_TILE_SIZE) / VIEWER_TILE_SIZE;
+            float v0 = (y0 / texel - r * VIEWER_TILE_SIZE) / VIEWER_TILE_SIZE;
+            float v1 = (y1 / texel - r * VIEWER_TILE_SIZE) / VIEWER_TILE_SIZE;
+
+            GLfloat quad[] = {
+                x1, height - y1, 0.0,   u1, v1,
+                x1, height - y0, 0.0,   u1, v0,
+                x0, height - y0, 0.0,   u0, v0,
+                x0, height - y1, 0.0,   u0, v1,
+            };
+            memcpy(v->vertices + count * LENGTH(quad), quad, sizeof(quad));
+            v->textures[count++] = v->slots[s].id;
+        }
+    }
+
+    GL(glBindVertexArray(v->vao));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, v->vbo));
+    GL(glBufferData(GL_ARRAY_BUFFER, count * 4 * 5 * sizeof(GLfloat), v->vertices, GL_STREAM_DRAW));
+    for (int i = 0; i < count; i++) {
+        GL(glBindTexture(GL_TEXTURE_2D, v->textures[i]));
+        GL(glDrawArrays(GL_TRIANGLE_FAN, 4 * i, 4));
+    }
+    GL(glBindVertexArray(0));
+}
+
+/* GPU memory held by the slots and the upload buffer */
+size_t
+viewer_bytes(const Viewer *v)
+{
+    return v->slot_count * TILE_BYTES + (v->pbo ? TILE_BYTES : 0);
+}
+
+void
+viewer_destroy(Viewer *v)
+{
+    for (int i = 0; v->slots && i < v->slot_count; i++)
+        glDeleteTextures(1, &v->slots[i].id);
+    free(v->slots);
+    for (int i = 0; i < v->level_count; i++)
+        free(v->levels[i].slots);
+    free(v->vertices);
+    free(v->textures);
+
+    if (v->pbo)
+        glDeleteBuffers(1, &v->pbo);
+    if (v->vao) {
+        glDeleteVertexArrays(1, &v->vao);
+        glDeleteBuffers(1, &v->vbo);
+    }
+    memset(v, 0, sizeof(*v));
+}
@@ -0,0 +1,72 @@
+#ifndef ZOOC_VIEWER_H
+#define ZOOC_VIEWER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/gl.h>
+
+#include "image.h"
+#include "sampling.h"
+#include "vec.h"
+
+#define VIEWER_TILE_SIZE    512
+#define VIEWER_LEVEL_MAX    32
+
+/* Level n of the pyramid is the image shrunk by 2^n, cut into tiles. Each
+ * tile knows the slot holding it, or -1.
+ */
+typedef struct {
+    int width;
+    int height;
+    int cols;
+    int rows;
+    int *slots;
+} ViewerLevel;
+
+/* A texture holding one tile of some level */
+typedef struct {
+    GLuint id;
+    int level;
+    int col;
+    int row;
+    uint64_t used;
+} ViewerSlot;
+
+/* An image file shown through a mip pyramid of tiles. Only the tiles of the
+ * level that suits the camera's scale and that are in view are converted
+ * and uploaded, into a fixed number of slots. Once they are all taken, the
+ * slot least recently drawn is given to the next tile. Tiles still missing
+ * are drawn from the coarser levels, down to the single tile of the top
+ * one, which always stays.
+ */
+typedef struct {
+    const Image *image;
+    int level_count;
+    ViewerLevel levels[VIEWER_LEVEL_MAX];
+    int shown;
+
+    ViewerSlot *slots;
+    int slot_count;
+    int slot_limit;
+    uint64_t frame;
+
+    Minify minify;
+    Magnify magnify;
+
+    GLuint pbo;
+    GLuint vao;
+    GLuint vbo;
+    GLfloat *vertices;
+    GLuint *textures;
+    int quad_capacity;
+} Viewer;
+
+void viewer_create(Viewer *, const Image *, size_t, Vec2f);
+void viewer_set_sampling(Viewer *, Minify, Magnify);
+size_t viewer_update(Viewer *, float, Vec2f, Vec2f, Vec2f, size_t);
+void viewer_draw(Viewer *, Vec2f, Vec2f);
+size_t viewer_bytes(const Viewer *);
+void viewer_destroy(Viewer *);
+
+#endif
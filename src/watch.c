@@ -0,0 +1,76 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "watch.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE)
+
+static int classify(const char *);
+
+static int
+classify(const char *name)
+{
+    if (!strcmp(name, "config.conf"))
+        return WATCH_CONFIG;
+    if (!strcmp(name, "vertex.glsl") || !strcmp(name, "fragment.glsl")
+        || !strcmp(name, "filters.glsl"))
+        return WATCH_SHADERS;
+    return 0;
+}
+
+/* Watch the directories files are looked up in rather than the files,
+ * editors tend to save by writing a new file and renaming it over the old.
+ */
+bool
+watch_init(Watch *watch)
+{
+    char dir[CONFIG_PATH_SIZE];
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd == -1) {
+        fprintf(stderr, "Unable to watch the configuration: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (config_dir(dir, sizeof(dir)))
+        inotify_add_watch(watch->fd, dir, WATCH_EVENTS);
+    inotify_add_watch(watch->fd, "/etc/zooc", WATCH_EVENTS);
+    return true;
+}
+
+/* Drain the pending events. Returns which kinds of files changed, a save
+ * that shows up as several events is only reported once.
+ */
+int
+watch_read(Watch *watch)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t len;
+
+    if (watch->fd == -1)
+        return 0;
+
+    while ((len = read(watch->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len > 0)
+                changed |= classify(ev->name);
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return changed;
+}
+
+void
+watch_destroy(Watch *watch)
+{
+    if (watch->fd != -1)
+        close(watch->fd);
+    watch->fd = -1;
+}
@@ -0,0 +1,18 @@
+#ifndef ZOOC_WATCH_H
+#define ZOOC_WATCH_H
+
+#include <stdbool.h>
+
+#define WATCH_CONFIG    (1 << 0)
+#define WATCH_SHADERS   (1 << 1)
+
+/* Notices edits to the configuration and the shaders through inotify */
+typedef struct {
+    int fd;
+} Watch;
+
+bool watch_init(Watch *);
+int watch_read(Watch *);
+void watch_destroy(Watch *);
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <GL/glew.h>
+#include <GL/glx.h>
+
+#include <X11/Xlib.h>
+
+#include "src/convert.h"
+#include "src/filter.h"
+#include "src/texture.h"
+#include "src/util.h"
+#include "src/vec.h"
+
+/* Pixels past the first tile in both directions, so the image has a
+ * vertical and a horizontal tile border and a corner where four meet
+ */
+#define OVERHANG    48
+
+static bool compare(const char *, Texture *, const unsigned int *);
+static bool check_chain(const char *, const unsigned int *, int, int, const PixelFormat *);
+
+/* Check the filtered tiles against `expected`, the whole image filtered in
+ * one piece, and report the first texel that differs
+ */
+static bool
+compare(const char *chain, Texture *t, const unsigned int *expected)
+{
+    unsigned int *got = malloc((size_t)t->tile_size * t->tile_size * sizeof(*got));
+    bool ok = true;
+
+    if (got == NULL)
+        die("Malloc failed to allocate:");
+
+    for (int i = 0; ok && i < t->cols * t->rows; i++) {
+        Tile *tile = &t->tiles[i];
+
+        glBindTexture(GL_TEXTURE_2D, tile->filtered);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, got);
+
+        for (int y = 0; ok && y < tile->height; y++) {
+            for (int x = 0; ok && x < tile->width; x++) {
+                unsigned int want = expected[(size_t)(tile->y + y) * t->width + tile->x + x];
+                unsigned int have = got[(size_t)y * tile->width + x];
+
+                if (want != have) {
+                    fprintf(stderr, "%s at %d, %d: %08x, untiled gives %08x\n",
+                        chain, tile->x + x, tile->y + y, have, want);
+                    ok = false;
+                }
+            }
+        }
+    }
+    free(got);
+    return ok;
+}
+
+/* Filter the image tile by tile and in one piece, both must agree */
+static bool
+check_chain(const char *chain, const unsigned int *pixels, int width, int height,
+        const PixelFormat *format)
+{
+    FilterGraph g = {0};
+    Texture t;
+    GLuint whole, filtered = 0;
+    Vec2f view_min = {0.0f, 0.0f}, view_max = {width, height};
+    bool ok;
+
+    if (!filter_graph_load(&g, "filters.glsl", chain)) {
+        fprintf(stderr, "%s: the chain does not build\n", chain);
+        return false;
+    }
+
+    texture_create(&t, width, height, false);
+    texture_stream(&t, (void *)pixels, (size_t)width * sizeof(*pixels), format);
+    texture_stream_step(&t, 0, view_min, view_max, view_min);
+    texture_filter(&t, &g, view_min, view_max);
+
+    glGenTextures(1, &whole);
+    glBindTexture(GL_TEXTURE_2D, whole);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+        GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
+    filter_graph_apply(&g, whole, width, height, &filtered);
+
+    unsigned int *expected = malloc((size_t)width * height * sizeof(*expected));
+    if (expected == NULL)
+        die("Malloc failed to allocate:");
+    glBindTexture(GL_TEXTURE_2D, filtered);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, expected);
+
+    ok = compare(chain, &t, expected);
+    printf("%s: %s\n", chain, ok ? "tiles match" : "tiles differ");
+
+    free(expected);
+    glDeleteTextures(1, &whole);
+    glDeleteTextures(1, &filtered);
+    texture_destroy(&t);
+    filter_graph_destroy(&g);
+    return ok;
+}
+
+/* Filtering the screenshot a tile at a time must give what filtering it in
+ * one piece does, without seams where the tiles meet. Needs a display and
+ * a GL_MAX_TEXTURE_SIZE past the tile size, and is skipped without them.
+ */
+int
+main(void)
+{
+    const char *chains[] = {
+        "edges",
+        "contrast:1.5,edges",
+        "edges,invert,edges,grayscale",
+    };
+    const PixelFormat format = { LAYOUT_BGRX8888, 4, 0xff0000, 0xff00, 0xff, false };
+    bool ok = true;
+
+    /* Nothing is cached, every chain is compiled from filters.glsl */
+    setenv("XDG_CACHE_HOME", "/dev/null/zooc", 1);
+
+    Display *dpy = XOpenDisplay(NULL);
+    int attrs[] = { GLX_RGBA, GLX_DOUBLEBUFFER, None };
+    XVisualInfo *vi = dpy != NULL ? glXChooseVisual(dpy, DefaultScreen(dpy), attrs) : NULL;
+
+    if (vi == NULL) {
+        printf("No display, tiled filtering is not checked\n");
+        if (dpy != NULL)
+            XCloseDisplay(dpy);
+        return 0;
+    }
+
+    XSetWindowAttributes swa = {0};
+    swa.colormap = XCreateColormap(dpy, DefaultRootWindow(dpy), vi->visual, AllocNone);
+    Window w = XCreateWindow(dpy, DefaultRootWindow(dpy), 0, 0, 16, 16, 0,
+        vi->depth, InputOutput, vi->visual, CWColormap, &swa);
+    GLXContext glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
+    glXMakeCurrent(dpy, w, glc);
+
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Couldnt initialize glew!\n");
+        ok = false;
+    } else {
+        GLint max_size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+        int size = MIN(max_size, TEXTURE_MAX_TILE_SIZE) + OVERHANG;
+
+        if (size > max_size) {
+            printf("Textures of %d texels are too small, tiled filtering is not checked\n",
+                max_size);
+        } else {
+            unsigned int *pixels = malloc((size_t)size * size * sizeof(*pixels));
+            if (pixels == NULL)
+                die("Malloc failed to allocate:");
+
+            /* Noise, so every texel of the neighbourhood counts */
+            srand(1);
+            for (size_t i = 0; i < (size_t)size * size; i++)
+                pixels[i] = 0xff000000u | (rand() & 0xffffff);
+
+            for (size_t i = 0; i < LENGTH(chains); i++)
+                ok &= check_chain(chains[i], pixels, size, size, &format);
+            free(pixels);
+        }
+    }
+
+    glXMakeCurrent(dpy, None, NULL);
+    glXDestroyContext(dpy, glc);
+    XDestroyWindow(dpy, w);
+    XFree(vi);
+    XCloseDisplay(dpy);
+
+    printf("filter: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "src/config.h"
+#include "src/navigation.h"
+#include "src/util.h"
+#include "src/vec.h"
+
+/* Relative tolerance, float rounding adds up over the short steps */
+#define TOLERANCE   1e-3f
+#define DURATION    0.75f
+
+static bool close_to(float, float);
+static bool check(const char *, int, float, float);
+static void run_camera(Camera *, Config *, int);
+static void run_flashlight(Flashlight *, int);
+
+static int failures = 0;
+
+static bool
+close_to(float a, float b)
+{
+    return fabsf(a - b) <= TOLERANCE * fmaxf(1.0f, fmaxf(fabsf(a), fabsf(b)));
+}
+
+static bool
+check(const char *what, int steps, float expected, float got)
+{
+    if (close_to(expected, got))
+        return true;
+
+    fprintf(stderr, "%s after %d steps: %f, one step gives %f\n",
+        what, steps, got, expected);
+    failures++;
+    return false;
+}
+
+/* Advance the camera by DURATION seconds split into `steps` frames */
+static void
+run_camera(Camera *cam, Config *config, int steps)
+{
+    Mouse mouse = {0};
+    Vec2f window_size = {1920.0f, 1080.0f};
+
+    cam->dt = DURATION / steps;
+    for (int i = 0; i < steps; i++)
+        update_camera(cam, config, &mouse, window_size);
+}
+
+static void
+run_flashlight(Flashlight *fl, int steps)
+{
+    for (int i = 0; i < steps; i++)
+        update_flashlight(fl, DURATION / steps);
+}
+
+/* One step of N * h has to land where N steps of h do, for both a motion
+ * that is still coasting at the end and one that stops halfway.
+ */
+int
+main(void)
+{
+    const int splits[] = {2, 3, 10, 60, 144, 1000};
+    Config config = {
+        .min_scale = 0.1f,
+        .max_scale = 6.0f,
+        .drag_friction = 6.0f,
+        .scale_friction = 4.0f,
+    };
+    const Camera starts[] = {
+        {
+            .position = {12.0f, -40.0f},
+            .velocity = {2400.0f, -900.0f},
+            .scale_pivot = {300.0f, 700.0f},
+            .scale = 1.0f,
+            .delta_scale = 3.0f,
+        },
+        {
+            .position = {0.0f, 0.0f},
+            .velocity = {40.0f, 10.0f},
+            .scale_pivot = {960.0f, 0.0f},
+            .scale = 2.5f,
+            .delta_scale = -1.0f,
+        },
+    };
+    const Flashlight lights[] = {
+        { .is_enabled = true, .shadow = 0.0f, .radius = 200.0f, .delta_radius = 1500.0f },
+        { .is_enabled = false, .shadow = 0.8f, .radius = 90.0f, .delta_radius = -4.0f },
+    };
+
+    for (size_t s = 0; s < LENGTH(starts); s++) {
+        Camera once = starts[s];
+        run_camera(&once, &config, 1);
+
+        for (size_t i = 0; i < LENGTH(splits); i++) {
+            Camera cam = starts[s];
+            run_camera(&cam, &config, splits[i]);
+
+            check("camera x", splits[i], once.position.x, cam.position.x);
+            check("camera y", splits[i], once.position.y, cam.position.y);
+            check("velocity x", splits[i], once.velocity.x, cam.velocity.x);
+            check("velocity y", splits[i], once.velocity.y, cam.velocity.y);
+            check("scale", splits[i], once.scale, cam.scale);
+            check("scale speed", splits[i], once.delta_scale, cam.delta_scale);
+        }
+    }
+
+    for (size_t s = 0; s < LENGTH(lights); s++) {
+        Flashlight once = lights[s];
+        run_flashlight(&once, 1);
+
+        for (size_t i = 0; i < LENGTH(splits); i++) {
+            Flashlight fl = lights[s];
+            run_flashlight(&fl, splits[i]);
+
+            check("radius", splits[i], once.radius, fl.radius);
+            check("radius speed", splits[i], once.delta_radius, fl.delta_radius);
+            check("shadow", splits[i], once.shadow, fl.shadow);
+        }
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "navigation: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("navigation: ok\n");
+    return 0;
+}
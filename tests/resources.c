@@ -0,0 +1,236 @@
+#define _XOPEN_SOURCE 700
+
+#include <dirent.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <GL/glew.h>
+#include <GL/glx.h>
+
+#include <X11/Xlib.h>
+
+#include "src/config.h"
+#include "src/shader.h"
+#include "src/watch.h"
+
+/* Rounds of each reload before and while the usage is measured. The slack
+ * covers malloc keeping a few pages around, a leak per round is far larger.
+ */
+#define WARMUP          50
+#define CONFIG_ROUNDS   5000
+#define SHADER_ROUNDS   500
+#define RSS_SLACK_KB    512
+
+typedef struct {
+    int fds;
+    long rss_kb;
+} Usage;
+
+static Usage usage(void);
+static bool flat(const char *, Usage, Usage);
+static bool write_file(const char *, const char *, const char *);
+static bool reload_config(Watch *, const char *, int);
+static bool reload_shaders(Config *);
+static int remove_entry(const char *, const struct stat *, int, struct FTW *);
+
+static const char *vertex_src =
+    "#version 130\n"
+    "void main() { gl_Position = vec4(0.0); }\n";
+
+static const char *fragment_src =
+    "#version 130\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "#ifdef DIM\n"
+    "    color = vec4(0.5);\n"
+    "#else\n"
+    "    color = vec4(1.0);\n"
+    "#endif\n"
+    "}\n";
+
+/* Open descriptors and resident memory of this process */
+static Usage
+usage(void)
+{
+    Usage u = { .fds = 0, .rss_kb = -1 };
+    char line[256];
+
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir != NULL) {
+        while (readdir(dir) != NULL)
+            u.fds++;
+        closedir(dir);
+    }
+
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (!strncmp(line, "VmRSS:", 6))
+                u.rss_kb = strtol(line + 6, NULL, 10);
+        }
+        fclose(fp);
+    }
+    return u;
+}
+
+static bool
+flat(const char *what, Usage before, Usage after)
+{
+    bool ok = after.fds == before.fds && after.rss_kb - before.rss_kb <= RSS_SLACK_KB;
+
+    fprintf(ok ? stdout : stderr, "%s: %d -> %d descriptors, %ld -> %ld kB resident\n",
+        what, before.fds, after.fds, before.rss_kb, after.rss_kb);
+    return ok;
+}
+
+static bool
+write_file(const char *dir, const char *name, const char *contents)
+{
+    char path[CONFIG_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return false;
+    fputs(contents, fp);
+    return fclose(fp) == 0;
+}
+
+/* What zooc does after an edit to config.conf */
+static bool
+reload_config(Watch *watch, const char *dir, int rounds)
+{
+    char contents[64];
+    Config config;
+    bool ok = true;
+
+    for (int i = 0; i < rounds; i++) {
+        snprintf(contents, sizeof(contents), "scroll_speed = %d\nfilters = none\n", i % 7 + 1);
+        write_file(dir, "config.conf", contents);
+
+        if (!(watch_read(watch) & WATCH_CONFIG) || !load_config(&config)) {
+            fprintf(stderr, "Round %d: the configuration was not reloaded\n", i);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* What zooc does after an edit to one of the shaders */
+static bool
+reload_shaders(Config *config)
+{
+    ShaderBuild build;
+    Shaders shaders;
+    ShaderStatus status;
+
+    if (!shaders_build(&build, config->vertex_shader_file, config->fragment_shader_file, ""))
+        return false;
+    while ((status = shaders_poll(&build, &shaders)) == SHADERS_PENDING)
+        ;
+    if (status != SHADERS_READY)
+        return false;
+    shaders_destroy(&shaders);
+    return true;
+}
+
+static int
+remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+/* Reloading the configuration and the shaders over and over must not leak
+ * descriptors or memory. Everything happens under a temporary
+ * XDG_CONFIG_HOME and XDG_CACHE_HOME. The shaders need a display and are
+ * skipped without one.
+ */
+int
+main(void)
+{
+    char home[] = "/tmp/zooc-test-XXXXXX";
+    char dir[CONFIG_PATH_SIZE], cache[CONFIG_PATH_SIZE];
+    bool ok = true;
+    Watch watch;
+    Config config;
+
+    if (mkdtemp(home) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(cache, sizeof(cache), "%s/cache", home);
+    setenv("XDG_CONFIG_HOME", home, 1);
+    setenv("XDG_CACHE_HOME", cache, 1);
+
+    if (!config_dir(dir, sizeof(dir))
+        || !write_file(dir, "config.conf", "filters = none\n")
+        || !write_file(dir, "vertex.glsl", vertex_src)
+        || !write_file(dir, "fragment.glsl", fragment_src)
+        || !watch_init(&watch)
+        || !load_config(&config)) {
+        fprintf(stderr, "Unable to set up a configuration in %s\n", home);
+        nftw(home, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return 1;
+    }
+
+    ok &= reload_config(&watch, dir, WARMUP);
+    Usage before = usage();
+    ok &= reload_config(&watch, dir, CONFIG_ROUNDS);
+    ok &= flat("load_config and watch_read", before, usage());
+    watch_destroy(&watch);
+
+    Display *dpy = XOpenDisplay(NULL);
+    int attrs[] = { GLX_RGBA, GLX_DOUBLEBUFFER, None };
+    XVisualInfo *vi = dpy != NULL ? glXChooseVisual(dpy, DefaultScreen(dpy), attrs) : NULL;
+
+    if (vi == NULL) {
+        printf("No display, the shader rebuild is not checked\n");
+    } else {
+        XSetWindowAttributes swa = {0};
+        swa.colormap = XCreateColormap(dpy, DefaultRootWindow(dpy), vi->visual, AllocNone);
+        Window w = XCreateWindow(dpy, DefaultRootWindow(dpy), 0, 0, 16, 16, 0,
+            vi->depth, InputOutput, vi->visual, CWColormap, &swa);
+        GLXContext glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
+        glXMakeCurrent(dpy, w, glc);
+
+        if (glewInit() != GLEW_OK) {
+            fprintf(stderr, "Couldnt initialize glew!\n");
+            ok = false;
+        } else {
+            /* Once with the programs coming out of the cache, once with
+             * the cache out of reach so every round compiles them.
+             */
+            for (int pass = 0; pass < 2; pass++) {
+                if (pass == 1)
+                    setenv("XDG_CACHE_HOME", "/dev/null/zooc", 1);
+
+                for (int i = 0; i < WARMUP; i++)
+                    ok &= reload_shaders(&config);
+                before = usage();
+                for (int i = 0; i < SHADER_ROUNDS; i++)
+                    ok &= reload_shaders(&config);
+                ok &= flat(pass == 0 ? "cached shader rebuild" : "shader rebuild",
+                    before, usage());
+            }
+        }
+
+        glXMakeCurrent(dpy, None, NULL);
+        glXDestroyContext(dpy, glc);
+        XDestroyWindow(dpy, w);
+        XFree(vi);
+    }
+    if (dpy != NULL)
+        XCloseDisplay(dpy);
+
+    nftw(home, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    printf("resources: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}